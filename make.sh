@@ -3,16 +3,65 @@
 # Script to compile the C++ Synth project
 
 # Make bin folder
-mkdir bin
+mkdir -p bin
 
 #version
 version="v0.1.1-alpha"
 
+# Engine sources shared by the GUI and headless builds
+engine_sources="
+    src/Oscillator.cpp
+    src/AudioGraph.cpp
+    src/WorkerPool.cpp
+    src/AudioEngine.cpp
+    src/AudioBackend.cpp
+    src/PortAudioBackend.cpp
+    src/Realtime.cpp
+    src/RealtimeGuard.cpp
+    src/Options.cpp
+    src/LoadMeter.cpp
+    src/WavWriter.cpp
+    src/NoteSequence.cpp
+    src/RecordBuffer.cpp
+    src/Clip.cpp
+    src/Instrument.cpp
+    src/NoteTake.cpp
+    src/PeakCache.cpp
+    src/ScopeRing.cpp
+    src/LevelMeter.cpp
+    src/MidiFile.cpp"
+
+# RT_GUARD=1 ./make.sh builds with the real-time safety checker, which
+# reports allocations, locks and blocking calls on the audio thread
+guard_flags=""
+if [ "$RT_GUARD" = "1" ]; then
+    guard_flags="-DSYNTH_RT_GUARD -g -rdynamic"
+fi
+
+# ./make.sh test builds the headless tests with the real-time safety
+# checker and without PortAudio (they only use the null and file
+# backends), runs them (aborting on the first violation) and stops there
+if [ "$1" = "test" ]; then
+    test_sources=$(echo $engine_sources | tr ' ' '\n' | grep -v PortAudioBackend)
+    g++ -std=c++11 -DSYNTH_RT_GUARD -DSYNTH_NO_PORTAUDIO -g -rdynamic \
+        tests/*.cpp \
+        $test_sources \
+        -o ./bin/synth-tests \
+        -I./src \
+        -I./lib \
+        -ldl \
+        -lpthread || exit 1
+    SYNTH_RT_GUARD=abort ./bin/synth-tests
+    exit $?
+fi
+
 # Compile the C++ code
-g++ -std=c++11 \
+g++ -std=c++11 $guard_flags \
     src/main.cpp \
-    src/Oscillator.cpp \
     src/Keyboard.cpp \
+    src/TimelineCache.cpp \
+    src/SpectrumAnalyzer.cpp \
+    $engine_sources \
     ./lib/imgui/*.cpp \
     ./lib/imgui/backends/imgui_impl_glfw.cpp \
     ./lib/imgui/backends/imgui_impl_opengl3.cpp \
@@ -28,16 +77,31 @@ g++ -std=c++11 \
     -ldl \
     -lpthread
 
+# Compile the headless engine (no GLFW, ImGui or OpenGL)
+g++ -std=c++11 $guard_flags \
+    src/headless.cpp \
+    $engine_sources \
+    -o ./bin/synth-headless$version \
+    -I./lib \
+    -L./lib \
+    -lportaudio \
+    -ldl \
+    -lpthread
+
 # Explanation of the options used:
 # -std=c++11: Specifies the C++ language version to use.
-# src/main.cpp, src/Oscillator.cpp, src/Keyboard.cpp: Source files to compile.
+# $guard_flags: -DSYNTH_RT_GUARD enables the checker, -g and -rdynamic give its stack traces names.
+# -DSYNTH_NO_PORTAUDIO: Leaves the PortAudio backend out of the test build.
+# src/main.cpp, src/Keyboard.cpp, src/TimelineCache.cpp, src/SpectrumAnalyzer.cpp: GUI front end source files.
+# src/headless.cpp: Headless front end source file.
+# tests/*.cpp: Headless tests, built and run by ./make.sh test.
+# $engine_sources: Synth engine source files used by both binaries.
 # ./lib/imgui/*.cpp: ImGui library source files.
 # ./lib/imgui/backends/imgui_impl_glfw.cpp: ImGui GLFW backend source file.
 # ./lib/imgui/backends/imgui_impl_opengl3.cpp: ImGui OpenGL3 backend source file.
-# -o ./bin/synth: Output binary file name and location.
-# -I./lib/imgui, -I./lib/imgui/backends, -I./lib: Include directories for header files.
+# -o ./bin/synth, -o ./bin/synth-headless, -o ./bin/synth-tests: Output binary file names and location.
+# -I./src, -I./lib/imgui, -I./lib/imgui/backends, -I./lib: Include directories for header files.
 # -L./lib: Library directory.
 # -lportaudio, -lglfw, -lGLEW, -lGL, -ldl, -lpthread: Linked libraries.
 
 # End of script
-
@@ -0,0 +1,84 @@
+#ifndef ATOMICTABLE_H
+#define ATOMICTABLE_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// A fixed-capacity table of atomic pointers whose slots are allocated in
+// pages of kPageSlots the first time one of them is needed, so a table
+// sized for hours of audio costs about a kilobyte until it is used. Pages
+// never move and are only freed with the table, so a reader that found a
+// slot can keep using it. Pages are created off the audio thread, possibly
+// by two threads at once; the audio thread only looks slots up.
+template <typename T>
+class AtomicTable {
+public:
+    static const size_t kPageSlots = 64;
+
+    explicit AtomicTable(size_t capacity)
+        : pageCount((capacity + kPageSlots - 1) / kPageSlots),
+          pages(new std::atomic<Page*>[pageCount])
+    {
+        for (size_t i = 0; i < pageCount; ++i) pages[i].store(nullptr);
+    }
+
+    // Frees the pages, not what the slots point to
+    ~AtomicTable()
+    {
+        for (size_t i = 0; i < pageCount; ++i) delete pages[i].load();
+    }
+
+    AtomicTable(const AtomicTable&) = delete;
+    AtomicTable& operator=(const AtomicTable&) = delete;
+
+    size_t capacity() const { return pageCount * kPageSlots; }
+
+    // Slot `index`, or null if its page has not been created
+    std::atomic<T*>* find(size_t index) const
+    {
+        Page* page = pages[index / kPageSlots].load(std::memory_order_acquire);
+        return page ? &page->slots[index % kPageSlots] : nullptr;
+    }
+
+    // Pointer in slot `index`, null for a missing page
+    T* load(size_t index) const
+    {
+        std::atomic<T*>* s = find(index);
+        return s ? s->load(std::memory_order_acquire) : nullptr;
+    }
+
+    // Slot `index`, creating its page if needed; never on the audio thread
+    std::atomic<T*>& slot(size_t index)
+    {
+        std::atomic<Page*>& entry = pages[index / kPageSlots];
+        Page* page = entry.load(std::memory_order_acquire);
+        if (!page) {
+            std::unique_ptr<Page> fresh(new Page());
+            if (entry.compare_exchange_strong(page, fresh.get(), std::memory_order_acq_rel)) {
+                page = fresh.release();
+            }
+        }
+        return page->slots[index % kPageSlots];
+    }
+
+private:
+    struct Page {
+        std::atomic<T*> slots[kPageSlots];
+
+        Page()
+        {
+            for (auto &s : slots) s.store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    size_t pageCount;
+    std::unique_ptr<std::atomic<Page*>[]> pages;
+};
+
+template <typename T>
+const size_t AtomicTable<T>::kPageSlots;
+
+#endif // ATOMICTABLE_H
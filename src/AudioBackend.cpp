@@ -0,0 +1,173 @@
+#include "AudioBackend.h"
+#include "AudioEngine.h"
+#if !defined(SYNTH_NO_PORTAUDIO)
+#include "PortAudioBackend.h"
+#endif
+#include "WavWriter.h"
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+std::unique_ptr<AudioBackend> createAudioBackend(const std::string& name, std::string& error)
+{
+    if (name == "portaudio") {
+#if defined(SYNTH_NO_PORTAUDIO)
+        // The headless tests are built without PortAudio
+        error = "built without PortAudio";
+        return nullptr;
+#else
+        std::unique_ptr<PortAudioBackend> backend(new PortAudioBackend());
+        if (!backend->initialize(error)) return nullptr;
+        return std::unique_ptr<AudioBackend>(std::move(backend));
+#endif
+    }
+    if (name == "null") {
+        return std::unique_ptr<AudioBackend>(new NullBackend());
+    }
+    if (name == "file") {
+        return std::unique_ptr<AudioBackend>(new FileBackend());
+    }
+    error = "unknown audio backend " + name;
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// ClockedBackend
+
+ClockedBackend::ClockedBackend() : running(false), latency(0.0) {}
+
+ClockedBackend::~ClockedBackend()
+{
+    close();
+}
+
+bool ClockedBackend::open(const AudioSettings& settings, Client& client, std::string& error)
+{
+    close();
+    if (!openSink(settings, error)) return false;
+
+    // Nothing is queued behind the block being rendered
+    latency = settings.framesPerBuffer / settings.sampleRate;
+    running = true;
+    thread = std::thread(&ClockedBackend::clockThread, this, &client,
+                         settings.sampleRate, settings.framesPerBuffer);
+    return true;
+}
+
+void ClockedBackend::close()
+{
+    if (!running) return;
+    running = false;
+    thread.join();
+    closeSink();
+}
+
+double ClockedBackend::getOutputLatency() const
+{
+    return latency;
+}
+
+bool ClockedBackend::openSink(const AudioSettings&, std::string&)
+{
+    return true;
+}
+
+void ClockedBackend::closeSink() {}
+
+void ClockedBackend::deliver(const float*, unsigned long) {}
+
+void ClockedBackend::clockThread(Client* client, double sampleRate, unsigned long frames)
+{
+    typedef std::chrono::steady_clock Clock;
+    std::vector<float> block(frames * 2);
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(frames / sampleRate));
+    Clock::time_point next = Clock::now();
+
+    while (running) {
+        // Missing a whole period is what a device would report as an
+        // underflow; resynchronise instead of trying to catch up
+        bool xrun = Clock::now() > next + period;
+        if (xrun) next = Clock::now();
+
+        client->renderAudio(block.data(), frames, xrun);
+        deliver(block.data(), frames);
+
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// NullBackend
+
+const char* NullBackend::getName() const
+{
+    return "null";
+}
+
+// ---------------------------------------------------------------------------
+// FileBackend
+
+struct FileBackend::Sink {
+    std::unique_ptr<WavWriter> wav;
+    std::ofstream raw;
+};
+
+FileBackend::FileBackend() {}
+
+FileBackend::~FileBackend()
+{
+    // Stop the clock before the sink goes away
+    close();
+}
+
+const char* FileBackend::getName() const
+{
+    return "file";
+}
+
+bool FileBackend::openSink(const AudioSettings& settings, std::string& error)
+{
+    const std::string& path = settings.outputFile;
+    if (path.empty()) {
+        error = "the file backend needs an output file";
+        return false;
+    }
+
+    sink.reset(new Sink());
+    bool wav = path.size() >= 4 && path.compare(path.size() - 4, 4, ".wav") == 0;
+    try {
+        if (wav) {
+            sink->wav.reset(new WavWriter(path, settings.sampleRate, 2));
+        } else {
+            sink->raw.open(path, std::ios::binary | std::ios::trunc);
+            if (!sink->raw.is_open()) throw std::runtime_error("Could not open file for writing: " + path);
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+        sink.reset();
+        return false;
+    }
+    return true;
+}
+
+void FileBackend::closeSink()
+{
+    sink.reset();
+}
+
+void FileBackend::deliver(const float* block, unsigned long frames)
+{
+    if (sink->wav) {
+        // A full disk must not take the clock thread down; stop writing
+        try {
+            sink->wav->write(block, frames);
+        } catch (const std::exception&) {
+            sink->wav.reset();
+        }
+    } else if (sink->raw) {
+        sink->raw.write(reinterpret_cast<const char*>(block), frames * 2 * sizeof(float));
+    }
+}
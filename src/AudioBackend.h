@@ -0,0 +1,93 @@
+#ifndef AUDIOBACKEND_H
+#define AUDIOBACKEND_H
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+struct AudioSettings;
+
+// Output device layer. A backend owns the real-time thread and asks its
+// client for interleaved stereo blocks; the engine never talks to a
+// device API directly.
+class AudioBackend {
+public:
+    class Client {
+    public:
+        virtual ~Client() {}
+        // Called on the backend's audio thread for every block. `xrun` is
+        // set when the device reported an underflow before this block.
+        virtual void renderAudio(float* out, unsigned long frames, bool xrun) = 0;
+    };
+
+    virtual ~AudioBackend() {}
+
+    // Open and start a stream. Returns false and sets `error` on failure.
+    virtual bool open(const AudioSettings& settings, Client& client, std::string& error) = 0;
+    // Stop and close the stream, if open
+    virtual void close() = 0;
+
+    // Output latency of the open stream in seconds
+    virtual double getOutputLatency() const = 0;
+    virtual const char* getName() const = 0;
+};
+
+// Create a backend by name: "portaudio", "null" or "file". Returns
+// nullptr and sets `error` for unknown names or initialisation failures.
+std::unique_ptr<AudioBackend> createAudioBackend(const std::string& name, std::string& error);
+
+// Base for backends without a device: a thread that clocks itself in real
+// time and hands every block to deliver()
+class ClockedBackend : public AudioBackend {
+public:
+    ClockedBackend();
+    ~ClockedBackend();
+
+    bool open(const AudioSettings& settings, Client& client, std::string& error) override;
+    void close() override;
+    double getOutputLatency() const override;
+
+protected:
+    // Prepare the sink; called from open() before the clock starts
+    virtual bool openSink(const AudioSettings& settings, std::string& error);
+    virtual void closeSink();
+    // Consume one rendered block on the clock thread
+    virtual void deliver(const float* block, unsigned long frames);
+
+private:
+    void clockThread(Client* client, double sampleRate, unsigned long frames);
+
+    std::thread thread;
+    std::atomic<bool> running;
+    double latency;
+};
+
+// Discards everything; useful for soak tests and benchmarks on machines
+// without a sound card
+class NullBackend : public ClockedBackend {
+public:
+    const char* getName() const override;
+};
+
+// Writes the real-time output to a WAV file (".wav") or raw interleaved
+// float32 samples (any other extension)
+class FileBackend : public ClockedBackend {
+public:
+    FileBackend();
+    ~FileBackend();
+    const char* getName() const override;
+
+protected:
+    bool openSink(const AudioSettings& settings, std::string& error) override;
+    void closeSink() override;
+    void deliver(const float* block, unsigned long frames) override;
+
+private:
+    struct Sink;
+    std::unique_ptr<Sink> sink;
+};
+
+#endif // AUDIOBACKEND_H
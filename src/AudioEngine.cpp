@@ -0,0 +1,895 @@
+#include "AudioEngine.h"
+#include "Realtime.h"
+#include "Denormals.h"
+#include "RealtimeGuard.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+
+// Output limiter: ceiling -0.3 dBFS, 1.5 ms lookahead (the latency it
+// adds) and 50 ms release
+static const float kLimiterCeiling = 0.966f;
+static const double kLimiterLookaheadSeconds = 0.0015;
+static const double kLimiterReleaseSeconds = 0.05;
+
+// callbackThreadState values
+static const int kThreadUnseen = 0;
+static const int kThreadSeen = 1;
+static const int kThreadPromoted = 2;
+
+// Interleave planar left/right channels into the stream's frame order
+static void interleave(const float* left, const float* right, float* out, unsigned long frames)
+{
+    unsigned long i = 0;
+#if defined(SYNTH_DENORMALS_SSE)
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i);
+        __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+#endif
+    for (; i < frames; ++i) {
+        out[2 * i] = left[i];
+        out[2 * i + 1] = right[i];
+    }
+}
+
+// File for a take on disk converted to `rate`, next to the original
+static std::string convertedPath(const std::string& path, double rate)
+{
+    std::string stem = path;
+    if (stem.size() > 4 && stem.compare(stem.size() - 4, 4, ".wav") == 0) {
+        stem.erase(stem.size() - 4);
+    }
+    return stem + "-" + std::to_string(static_cast<long>(rate)) + "Hz.wav";
+}
+
+AudioEngine::AudioEngine()
+    : volume(1.0f), delaySeconds(0.35f), delayFeedback(0.4f), limiterEnabled(true),
+      limiterCeiling(kLimiterCeiling), limiterGain(1.0f), running(false), housekeeping(true), takeCounter(0), nextSnapshot(0),
+      reconfigurePending(false), sampleRate(48000.0), flushDenormals(true), outputLatency(0.0), processingLatency(0),
+      callbackThreadState(0), configured(false), offlineRendering(false),
+      sequenceIndex(0), sequencePosition(0), masterBus(nullptr), effectsBus(nullptr)
+{
+    // Start with a graph for the default settings so instruments can be
+    // added before the engine is configured; its workers come with the
+    // first configure()
+    AudioSettings s = getSettings();
+    std::unique_ptr<AudioGraph> fresh = createGraph(s, false);
+    installGraph(fresh, s);
+    allocator = std::thread(&AudioEngine::allocatorThread, this);
+    disk = std::thread(&AudioEngine::diskThread, this);
+}
+
+AudioEngine::~AudioEngine()
+{
+    stop();
+    housekeeping = false;
+    housekeepingWake.notify_all();
+    allocator.join();
+    disk.join();
+    // Takes retire rather than being destroyed; with the disk thread gone,
+    // drop them here
+    graph.reset();
+    instruments.clear();
+    snapshots[0].reset();
+    snapshots[1].reset();
+    RecordBuffer::reclaimRetired();
+}
+
+void AudioEngine::allocatorThread()
+{
+    // Keep the takes being recorded stocked with spare chunks so the
+    // audio thread never allocates, and build the voices of note takes
+    // that were finished or changed. A chunk lasts over a second at any
+    // supported rate, so polling is plenty.
+    std::vector<std::shared_ptr<RecordBuffer>> buffers;
+    while (housekeeping) {
+        {
+            std::lock_guard<std::mutex> lock(instrumentsMutex);
+            for (auto &inst : instruments) {
+                for (const Clip& clip : inst.clips) {
+                    if (clip.take && clip.take.get() == inst.recordTarget) buffers.push_back(clip.take);
+                }
+            }
+        }
+        // Shared ownership keeps a take alive even if its clip is deleted
+        for (auto &buffer : buffers) {
+            buffer->refill();
+        }
+        buffers.clear();
+        buildNoteVoices();
+        std::unique_lock<std::mutex> lock(housekeepingMutex);
+        housekeepingWake.wait_for(lock, std::chrono::milliseconds(20), [this]{ return !housekeeping; });
+    }
+}
+
+void AudioEngine::buildNoteVoices()
+{
+    std::vector<std::pair<std::shared_ptr<NoteTake>, NoteTake::VoiceBuild>> builds;
+    {
+        std::lock_guard<std::mutex> lock(instrumentsMutex);
+        for (auto &inst : instruments) {
+            for (const Clip& clip : inst.clips) {
+                if (clip.notes && clip.notes->voicesPending()) {
+                    builds.push_back(std::make_pair(clip.notes, clip.notes->voiceRequest()));
+                }
+            }
+        }
+    }
+    if (builds.empty()) return;
+    for (auto &b : builds) {
+        b.second.build();
+    }
+    // The replaced voices end up in `builds` and are freed after unlocking
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    for (auto &b : builds) {
+        b.first->installVoices(b.second);
+    }
+}
+
+void AudioEngine::diskThread()
+{
+    // Spool writes happen in kWriteFrames pieces and read-ahead is whole
+    // chunks, so a short poll keeps well ahead of both
+    while (housekeeping) {
+        streamRecordings();
+        std::unique_lock<std::mutex> lock(housekeepingMutex);
+        housekeepingWake.wait_for(lock, std::chrono::milliseconds(10), [this]{ return !housekeeping; });
+    }
+}
+
+void AudioEngine::streamRecordings()
+{
+    struct Take {
+        std::shared_ptr<RecordBuffer> buffer;
+        std::string track;
+        RecordBuffer::StreamState state;
+    };
+    std::vector<Take> takes;
+    double rate = sampleRate.load();
+    std::string directory = getSettings().recordDirectory;
+    size_t loopStart = transport.beatToFrame(transport.loopStart.load(), rate);
+    size_t loopEnd = transport.beatToFrame(transport.loopEnd.load(), rate);
+    bool looping = transport.looping.load() && loopEnd > loopStart;
+    {
+        std::lock_guard<std::mutex> lock(instrumentsMutex);
+        for (auto &inst : instruments) {
+            for (const Clip& clip : inst.clips) {
+                if (!clip.take) continue;
+                size_t start = static_cast<size_t>(clip.start * rate);
+                Take t;
+                t.buffer = clip.take;
+                t.track = inst.name;
+                t.state.recording = inst.isRecording && clip.take.get() == inst.recordTarget;
+                t.state.playing = inst.isPlaying && inst.playIndex + RecordBuffer::kChunkFrames >= start;
+                t.state.playPosition = inst.playIndex > start ? inst.playIndex - start : 0;
+                // A loop start before the take falls in the start window
+                t.state.looping = looping && loopEnd > start;
+                t.state.loopPosition = loopStart > start ? loopStart - start : 0;
+                takes.push_back(t);
+            }
+        }
+    }
+
+    // Shared ownership keeps a take alive even if its clip is deleted
+    RecordBuffer::Evicted evicted;
+    for (Take& t : takes) {
+        try {
+            if (!directory.empty() && t.buffer->needsSpool()) {
+                t.buffer->startSpool(takePath(directory, t.track), rate);
+            }
+            t.buffer->stream(t.state, evicted);
+        } catch (const std::exception& e) {
+            std::cerr << t.track << ": " << e.what() << std::endl;
+        }
+    }
+
+    if (!evicted.empty()) {
+        // Readers only touch chunks with instrumentsMutex held, so once we
+        // have had the lock nobody can still be using an evicted chunk
+        { std::lock_guard<std::mutex> lock(instrumentsMutex); }
+        evicted.release();
+    }
+    takes.clear();
+    RecordBuffer::reclaimRetired();
+}
+
+std::string AudioEngine::takePath(const std::string& directory, const std::string& track)
+{
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+    localtime_r(&now, &local);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::string name = track;
+    std::replace(name.begin(), name.end(), ' ', '_');
+    return directory + "/" + name + "-" + stamp + "-" + std::to_string(++takeCounter) + ".wav";
+}
+
+void AudioEngine::configure(const AudioSettings& s)
+{
+    // Worker threads start here and the old graph's are joined when
+    // `fresh` goes, both outside the lock
+    std::unique_ptr<AudioGraph> fresh = createGraph(s, true);
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    checkNotRecording();
+    double oldRate = sampleRate.load();
+    {
+        std::lock_guard<std::mutex> settingsLock(settingsMutex);
+        settings = s;
+    }
+    sampleRate.store(s.sampleRate);
+    flushDenormals.store(s.flushDenormals);
+    convertSampleRate(oldRate, s.sampleRate);
+    configured = true;
+    installGraph(fresh, s);
+}
+
+void AudioEngine::start(const AudioSettings& s)
+{
+    if (running) return;
+
+    configure(s);
+    if (s.lockMemory) {
+        report("Memory", lockProcessMemory());
+    }
+    running = true;
+    thread = std::thread(&AudioEngine::audioThread, this);
+}
+
+void AudioEngine::stop()
+{
+    if (!running) return;
+    running = false;
+    thread.join();
+}
+
+void AudioEngine::reconfigure(const AudioSettings& s)
+{
+    {
+        std::lock_guard<std::mutex> lock(instrumentsMutex);
+        checkNotRecording();
+    }
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    pendingSettings = s;
+    reconfigurePending = true;
+}
+
+bool AudioEngine::isReconfiguring() const
+{
+    return reconfigurePending;
+}
+
+AudioSettings AudioEngine::getSettings() const
+{
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    return settings;
+}
+
+double AudioEngine::getSampleRate() const
+{
+    return sampleRate.load();
+}
+
+double AudioEngine::getOutputLatency() const
+{
+    return outputLatency.load();
+}
+
+double AudioEngine::getProcessingLatency() const
+{
+    return processingLatency.load() / sampleRate.load();
+}
+
+void AudioEngine::addInstrument(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    instruments.emplace_back(name);
+    addInstrumentNodes(instruments.back());
+    graph->compile();
+}
+
+void AudioEngine::addTrack(const std::string& name, const std::string& file)
+{
+    Clip clip;
+    clip.take->openFile(file, sampleRate.load());
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    instruments.emplace_back(name);
+    instruments.back().clips.push_back(clip);
+    instruments.back().reindex(sampleRate.load());
+    addInstrumentNodes(instruments.back());
+    graph->compile();
+}
+
+void AudioEngine::post(const Command& command)
+{
+    std::lock_guard<std::mutex> lock(commandsMutex);
+    commands.push_back(command);
+}
+
+std::shared_ptr<const UiSnapshot> AudioEngine::sync()
+{
+    std::vector<Command> pending;
+    {
+        std::lock_guard<std::mutex> lock(commandsMutex);
+        pending.swap(commands);
+    }
+
+    // Fill the snapshot the UI let go of last frame. Its strings and
+    // vectors keep their capacity, so the copy below normally allocates
+    // nothing; the old clip references are dropped before locking.
+    std::shared_ptr<UiSnapshot>& snapshot = snapshots[nextSnapshot];
+    nextSnapshot ^= 1;
+    // Last frame's, which the UI may still be reading; only read here
+    const UiSnapshot* previous = snapshots[nextSnapshot].get();
+    if (!snapshot || snapshot.use_count() > 1) {
+        snapshot = std::make_shared<UiSnapshot>();
+    }
+    for (auto &t : snapshot->tracks) {
+        t.clips.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    for (const Command& command : pending) {
+        command(*this);
+    }
+
+    double rate = sampleRate.load();
+    snapshot->sampleRate = rate;
+    snapshot->tracks.resize(instruments.size());
+    for (size_t i = 0; i < instruments.size(); ++i) {
+        const Instrument& inst = instruments[i];
+        TrackSnapshot& t = snapshot->tracks[i];
+        t.name = inst.name;
+        t.waveform = inst.waveform;
+        t.volume = inst.volume;
+        t.pan = inst.pan;
+        t.spread = inst.spread;
+        t.mute = inst.mute;
+        t.softClip = inst.softClip;
+        t.sendLevel = inst.sendLevel.load();
+        t.isRecording = inst.isRecording;
+        t.isPlaying = inst.isPlaying;
+        t.recordNotes = inst.recordNotes;
+        t.droppedFrames = inst.recordTarget ? inst.recordTarget->droppedFrames() : 0;
+        t.length = inst.length(rate);
+        t.clips.reserve(inst.clips.size());
+        for (size_t j = 0; j < inst.clips.size(); ++j) {
+            const Clip& clip = inst.clips[j];
+            t.clips.push_back(ClipSnapshot(clip, clip.frames(), inst.isRecordingInto(clip)));
+            if (!clip.take) continue;
+            // The spool path sits behind the take's disk lock, so it is
+            // copied from the last snapshot unless it has changed, and
+            // left stale for a frame rather than waited for
+            ClipSnapshot& c = t.clips.back();
+            const ClipSnapshot* before = nullptr;
+            if (previous && i < previous->tracks.size() && j < previous->tracks[i].clips.size() &&
+                previous->tracks[i].clips[j].clip.take == clip.take) {
+                before = &previous->tracks[i].clips[j];
+            }
+            unsigned version = clip.take->spoolPathVersion();
+            if (before && before->spoolPathVersion == version) {
+                c.spoolPath = before->spoolPath;
+                c.spoolPathVersion = version;
+            } else if (clip.take->tryGetSpoolPath(c.spoolPath)) {
+                c.spoolPathVersion = version;
+            } else if (before) {
+                c.spoolPath = before->spoolPath;
+                c.spoolPathVersion = before->spoolPathVersion;
+            }
+        }
+    }
+    return snapshot;
+}
+
+void AudioEngine::noteOn(size_t instrument, int note)
+{
+    // Build the voice (its band-limited wave tables) before locking
+    std::string waveform;
+    {
+        std::lock_guard<std::mutex> lock(instrumentsMutex);
+        if (instrument >= instruments.size()) return;
+        waveform = instruments[instrument].waveform;
+    }
+    Voice v(kVoiceTableSize, sampleRate.load());
+    v.note = note;
+    v.osc.setWaveform(waveform);
+    v.osc.setNote(note);
+
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    instruments[instrument].voices.push_back(std::move(v));
+}
+
+void AudioEngine::noteOff(size_t instrument, int note)
+{
+    // Released voices are freed after the lock is released
+    std::vector<Voice> released;
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    if (instrument >= instruments.size()) return;
+    std::vector<Voice>& voices = instruments[instrument].voices;
+    for (size_t i = 0; i < voices.size();) {
+        if (voices[i].note == note) {
+            released.push_back(std::move(voices[i]));
+            voices.erase(voices.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void AudioEngine::startSequenceNote(size_t instrument, int note)
+{
+    if (instrument >= instruments.size()) return;
+    Instrument& inst = instruments[instrument];
+    auto it = voicePrototypes.find(std::make_pair(instrument, note));
+    if (it == voicePrototypes.end() || inst.sequenceVoices.empty()) return;
+
+    std::vector<int>& notes = inst.sequenceNotes;
+    size_t slot = std::find(notes.begin(), notes.end(), -1) - notes.begin();
+    if (slot == notes.size()) slot = 0;
+    // Same-sized tables, so the copy reuses the slot's storage
+    inst.sequenceVoices[slot] = it->second;
+    notes[slot] = note;
+}
+
+void AudioEngine::stopSequenceNote(size_t instrument, int note)
+{
+    if (instrument >= instruments.size()) return;
+    std::vector<int>& notes = instruments[instrument].sequenceNotes;
+    auto it = std::find(notes.begin(), notes.end(), note);
+    if (it != notes.end()) *it = -1;
+}
+
+void AudioEngine::setSequence(const std::vector<NoteEvent>& events)
+{
+    std::vector<NoteEvent> sorted = events;
+    sortNoteEvents(sorted);
+
+    // Build the voice prototypes and a pool per instrument, sized for its
+    // polyphony in the sequence, before taking the lock; this is the
+    // expensive part (band-limited wave tables per note)
+    std::map<std::pair<size_t, int>, Voice> prototypes;
+    std::vector<std::vector<Voice>> pools;
+    std::vector<std::vector<int>> poolNotes;
+    {
+        std::vector<std::string> waveforms;
+        {
+            std::lock_guard<std::mutex> lock(instrumentsMutex);
+            for (auto &inst : instruments) waveforms.push_back(inst.waveform);
+        }
+        double rate = sampleRate.load();
+        std::vector<size_t> polyphony(waveforms.size(), 0), sounding(waveforms.size(), 0);
+        for (const NoteEvent& e : sorted) {
+            if (e.instrument < 0 || (size_t)e.instrument >= waveforms.size()) continue;
+            size_t i = (size_t)e.instrument;
+            if (!e.on) {
+                if (sounding[i] > 0) --sounding[i];
+                continue;
+            }
+            polyphony[i] = std::max(polyphony[i], ++sounding[i]);
+            std::pair<size_t, int> key(i, e.note);
+            if (prototypes.count(key)) continue;
+            Voice v(kVoiceTableSize, rate);
+            v.note = e.note;
+            v.osc.setWaveform(waveforms[i]);
+            v.osc.setNote(e.note);
+            prototypes.insert(std::make_pair(key, std::move(v)));
+        }
+        pools.resize(waveforms.size());
+        poolNotes.resize(waveforms.size());
+        for (auto &p : prototypes) {
+            size_t i = p.first.first;
+            if (pools[i].empty()) {
+                pools[i].assign(polyphony[i], p.second);
+                poolNotes[i].assign(polyphony[i], -1);
+            }
+        }
+    }
+
+    // The replaced prototypes and pools are freed after the lock is
+    // released, along with the locals they were swapped into
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    sequence.swap(sorted);
+    sequenceIndex = 0;
+    sequencePosition = 0;
+    voicePrototypes.swap(prototypes);
+    for (size_t i = 0; i < instruments.size() && i < pools.size(); ++i) {
+        instruments[i].sequenceVoices.swap(pools[i]);
+        instruments[i].sequenceNotes.swap(poolNotes[i]);
+    }
+}
+
+bool AudioEngine::isSequenceFinished()
+{
+    std::lock_guard<std::mutex> lock(instrumentsMutex);
+    return sequenceIndex >= sequence.size();
+}
+
+void AudioEngine::addInstrumentNodes(Instrument& inst)
+{
+    AudioNode* source = graph->addNode(std::unique_ptr<AudioNode>(new InstrumentNode(inst, transport, sampleRate.load())));
+    AudioNode* send = graph->addNode(std::unique_ptr<AudioNode>(new GainNode(inst.name + " Send", inst.sendLevel, sampleRate.load())));
+    graph->connect(source, masterBus);
+    graph->connect(source, send);
+    graph->connect(send, effectsBus);
+}
+
+std::unique_ptr<AudioGraph> AudioEngine::createGraph(const AudioSettings& s, bool withWorkers)
+{
+    int workerThreads = withWorkers ? s.workerThreads : 0;
+    if (workerThreads < 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        workerThreads = cores > 1 ? std::min(cores - 1, 3u) : 0;
+    }
+    // Workers run just below the audio thread, on their own cores if given
+    std::function<void(unsigned)> onWorkerStart = [this, s](unsigned index) {
+        if (s.flushDenormals) {
+            disableDenormalsForThread();
+        }
+        std::string granted = promoteCurrentThread(s.realtimePriority > 1 ? s.realtimePriority - 1
+                                                                          : s.realtimePriority);
+        if (!s.workerCpus.empty()) {
+            std::vector<int> cpu(1, s.workerCpus[index % s.workerCpus.size()]);
+            granted += ", " + pinCurrentThread(cpu);
+        }
+        report("Worker " + std::to_string(index + 1), granted);
+    };
+    return std::unique_ptr<AudioGraph>(new AudioGraph(s.framesPerBuffer, workerThreads, onWorkerStart));
+}
+
+// Build the fixed part of the graph: master bus -> master volume, and
+// effects bus -> delay -> master bus, then add every instrument
+void AudioEngine::installGraph(std::unique_ptr<AudioGraph>& fresh, const AudioSettings& s)
+{
+    graph.swap(fresh);
+    scopeMix.assign(s.framesPerBuffer, 0.0f);
+
+    masterBus = graph->addNode(std::unique_ptr<AudioNode>(new BusNode("Master Bus")));
+    effectsBus = graph->addNode(std::unique_ptr<AudioNode>(new BusNode("Effects Bus")));
+    AudioNode* delay = graph->addNode(std::unique_ptr<AudioNode>(
+        new DelayNode("Delay", s.sampleRate, 2.0f, delaySeconds, delayFeedback, s.dcInjection)));
+    AudioNode* master = graph->addNode(std::unique_ptr<AudioNode>(new GainNode("Master Volume", volume, s.sampleRate)));
+    AudioNode* limiter = graph->addNode(std::unique_ptr<AudioNode>(
+        new LimiterNode("Limiter", s.sampleRate, kLimiterLookaheadSeconds, kLimiterReleaseSeconds,
+                        limiterEnabled, limiterCeiling, limiterGain)));
+    processingLatency.store(limiter->latency());
+
+    graph->connect(effectsBus, delay);
+    graph->connect(delay, masterBus);
+    graph->connect(masterBus, master);
+    graph->connect(master, limiter);
+    graph->setOutput(limiter);
+
+    for (auto &inst : instruments) {
+        addInstrumentNodes(inst);
+    }
+    graph->compile();
+}
+
+void AudioEngine::checkNotRecording() const
+{
+    for (const auto &inst : instruments) {
+        if (inst.isRecording) {
+            throw std::runtime_error("Stop recording on " + inst.name + " before changing audio settings");
+        }
+    }
+}
+
+void AudioEngine::convertSampleRate(double from, double to)
+{
+    if (from == to) return;
+
+    double ratio = to / from;
+    for (auto &inst : instruments) {
+        // A take still being recorded has spares and an open spool file
+        // that resampling would tear down under it
+        if (inst.isRecording) inst.stopTake(from);
+        for (auto &v : inst.voices) {
+            v.osc.setSampleRate(to);
+        }
+        if (ratio != 1.0) {
+            for (Clip& clip : inst.clips) {
+                // Note clips only need voices built at the new rate
+                if (clip.notes) {
+                    clip.notes->prepare(to);
+                    continue;
+                }
+                if (clip.take->empty()) continue;
+                try {
+                    clip.take->resample(ratio, to, convertedPath(clip.take->spoolPath(), to));
+                } catch (const std::exception& e) {
+                    std::cerr << inst.name << ": " << e.what() << std::endl;
+                }
+            }
+        }
+        inst.reindex(to);
+        inst.playIndex = static_cast<size_t>(inst.playIndex * ratio);
+    }
+    for (auto &p : voicePrototypes) {
+        p.second.osc.setSampleRate(to);
+    }
+    for (auto &inst : instruments) {
+        for (auto &v : inst.sequenceVoices) {
+            v.osc.setSampleRate(to);
+        }
+    }
+    sequencePosition = static_cast<uint64_t>(sequencePosition * ratio);
+}
+
+void AudioEngine::render(float* out, unsigned long frames)
+{
+    // The flag is checked again under the lock so a callback that raced
+    // with renderOffline() cannot advance the offline render
+    if (!offlineRendering.load(std::memory_order_acquire)) {
+        // Never wait for an edit: while another thread holds the lock the
+        // block is silent, and counted as a dropout
+        std::unique_lock<std::mutex> lock(instrumentsMutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            loadMeter.recordLockMiss();
+            realtimeLockBusy("instrumentsMutex");
+        } else if (!offlineRendering.load(std::memory_order_acquire)) {
+            renderBlock(out, frames);
+            return;
+        }
+    }
+    std::fill(out, out + frames * 2, 0.0f);
+}
+
+OfflineRenderResult AudioEngine::renderOffline(const std::string& path, double tailSeconds,
+                                               WavWriter::Format format)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    WavWriter writer(path, getSampleRate(), 2, format);
+
+    // Take the graph away from the live stream and start every track from
+    // the top with a freshly built graph, so renders are deterministic
+    offlineRendering.store(true, std::memory_order_release);
+    // A bounce plays the arrangement once, straight through
+    bool looping = transport.looping.exchange(false);
+    std::vector<std::vector<Voice>> liveVoices;
+    AudioSettings s = getSettings();
+    std::unique_ptr<AudioGraph> fresh = createGraph(s, configured);
+    {
+        std::lock_guard<std::mutex> lock(instrumentsMutex);
+        for (auto &inst : instruments) {
+            liveVoices.push_back(std::move(inst.voices));
+            inst.voices.clear();
+            std::fill(inst.sequenceNotes.begin(), inst.sequenceNotes.end(), -1);
+            if (inst.isRecording) inst.stopTake(sampleRate.load());
+            inst.isPlaying = !inst.clips.empty();
+            inst.playIndex = 0;
+        }
+        sequenceIndex = 0;
+        sequencePosition = 0;
+        installGraph(fresh, s);
+    }
+    // The replaced graph's workers are joined outside the lock
+    fresh.reset();
+    // A take stopped just now has no voices yet
+    buildNoteVoices();
+
+    // Put the live voices back and hand the graph back to the stream
+    auto restore = [&]() {
+        std::lock_guard<std::mutex> lock(instrumentsMutex);
+        for (size_t i = 0; i < instruments.size() && i < liveVoices.size(); ++i) {
+            instruments[i].voices = std::move(liveVoices[i]);
+            std::fill(instruments[i].sequenceNotes.begin(), instruments[i].sequenceNotes.end(), -1);
+            instruments[i].isPlaying = false;
+            instruments[i].playIndex = 0;
+        }
+        transport.looping.store(looping);
+        offlineRendering.store(false, std::memory_order_release);
+    };
+
+    unsigned long blockFrames = getSettings().framesPerBuffer;
+    std::vector<float> block(blockFrames * 2);
+    uint64_t tailFrames = static_cast<uint64_t>(tailSeconds * getSampleRate());
+    uint64_t tailDone = 0;
+    // The limiter delays the output; leave out its first frames and render
+    // as many more at the end so the file lines up with the timeline
+    uint64_t latency = processingLatency.load();
+    tailFrames += latency;
+
+    try {
+        for (;;) {
+            bool playing = false;
+            {
+                std::lock_guard<std::mutex> lock(instrumentsMutex);
+                playing = sequenceIndex < sequence.size();
+                for (auto &inst : instruments) {
+                    playing = playing || inst.isPlaying || !inst.voices.empty() || inst.sequenceSounding();
+                }
+            }
+            if (!playing && tailDone >= tailFrames) break;
+
+            // Bring spooled takes into memory ahead of the render position;
+            // the disk thread alone cannot keep up with faster than real time
+            streamRecordings();
+            {
+                std::lock_guard<std::mutex> lock(instrumentsMutex);
+                renderBlock(block.data(), blockFrames);
+            }
+            unsigned long skip = static_cast<unsigned long>(std::min<uint64_t>(latency, blockFrames));
+            latency -= skip;
+            writer.write(block.data() + skip * 2, blockFrames - skip);
+            if (!playing) tailDone += blockFrames;
+        }
+        writer.close();
+    } catch (...) {
+        restore();
+        throw;
+    }
+    restore();
+
+    OfflineRenderResult result;
+    result.frames = writer.getFramesWritten();
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void AudioEngine::renderBlock(float* out, unsigned long framesPerBuffer)
+{
+    ScopedNoDenormals noDenormals(flushDenormals.load(std::memory_order_relaxed));
+    double rate = sampleRate.load();
+
+    // The graph is processed in blocks of at most its buffer size, split
+    // further at scheduled note events so they land on the exact sample
+    unsigned long done = 0;
+    while (done < framesPerBuffer)
+    {
+        unsigned long frames = std::min(framesPerBuffer - done, graph->getMaxFrames());
+
+        while (sequenceIndex < sequence.size()) {
+            const NoteEvent& e = sequence[sequenceIndex];
+            uint64_t at = static_cast<uint64_t>(e.time * rate + 0.5);
+            if (at > sequencePosition) {
+                frames = static_cast<unsigned long>(std::min<uint64_t>(frames, at - sequencePosition));
+                break;
+            }
+            if (e.on) {
+                startSequenceNote(e.instrument, e.note);
+            } else {
+                stopSequenceNote(e.instrument, e.note);
+            }
+            ++sequenceIndex;
+        }
+        if (sequenceIndex < sequence.size()) {
+            sequencePosition += frames;
+        }
+
+        const AudioNode* mix = graph->process(frames);
+        if (mix) {
+            const float* channels[2] = { mix->output(0), mix->output(1) };
+            masterMeter.process(channels, 2, frames, rate);
+            for (unsigned long k = 0; k < frames; ++k) {
+                scopeMix[k] = 0.5f * (channels[0][k] + channels[1][k]);
+            }
+            masterScope.write(scopeMix.data(), frames);
+            interleave(channels[0], channels[1], out, frames);
+        } else {
+            std::fill(out, out + frames * 2, 0.0f);
+        }
+        out += frames * 2;
+        done += frames;
+    }
+}
+
+void AudioEngine::renderAudio(float* out, unsigned long frames, bool xrun)
+{
+    // Backends may hand us a new thread whenever the stream is reopened.
+    // Note which one it is for audioThread() to promote.
+    if (callbackThreadState.load(std::memory_order_acquire) == kThreadUnseen) {
+        callbackThread = currentThreadId();
+        callbackThreadState.store(kThreadSeen, std::memory_order_release);
+    }
+
+    // Everything below must be real-time safe; checked in RT_GUARD builds
+    ScopedRealtimeSection realtime;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (xrun) {
+        loadMeter.recordXrun();
+    }
+    render(out, frames);
+
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    uint64_t deadline = static_cast<uint64_t>(1e9 * frames / getSampleRate());
+    loadMeter.record(elapsed, deadline);
+}
+
+void AudioEngine::setBackendError(const std::string& error)
+{
+    if (!error.empty()) {
+        std::cerr << error << std::endl;
+    }
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    backendError = error;
+}
+
+std::string AudioEngine::getBackendError() const
+{
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    return backendError;
+}
+
+void AudioEngine::report(const std::string& thread, const std::string& granted)
+{
+    std::cout << thread << ": " << granted << std::endl;
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    realtimeReport[thread] = granted;
+}
+
+std::string AudioEngine::getRealtimeReport() const
+{
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    std::string text;
+    for (auto &entry : realtimeReport) {
+        text += entry.first + ": " + entry.second + "\n";
+    }
+    return text;
+}
+
+void AudioEngine::audioThread()
+{
+    std::string error;
+    std::unique_ptr<AudioBackend> backend = createAudioBackend(getSettings().backend, error);
+    setBackendError(error);
+
+    while (running)
+    {
+        bool open = false;
+        callbackThreadState.store(kThreadUnseen, std::memory_order_release);
+        if (backend) {
+            error.clear();
+            open = backend->open(getSettings(), *this, error);
+            setBackendError(error);
+        }
+        outputLatency.store(open ? backend->getOutputLatency() : 0.0);
+
+        // Keep the stream running until settings change or the engine stops
+        while (running && !reconfigurePending)
+        {
+            if (callbackThreadState.load(std::memory_order_acquire) == kThreadSeen) {
+                AudioSettings s = getSettings();
+                report("Audio thread", promoteThread(callbackThread, s.realtimePriority) + ", " +
+                                       pinThread(callbackThread, s.audioCpus));
+                callbackThreadState.store(kThreadPromoted, std::memory_order_release);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        if (open) {
+            backend->close();
+        }
+
+        if (reconfigurePending) {
+            // Take the request first: one made while this one is applied
+            // sets the flag again and is applied on the next pass
+            AudioSettings next;
+            {
+                std::lock_guard<std::mutex> settingsLock(settingsMutex);
+                next = pendingSettings;
+                reconfigurePending = false;
+            }
+            // Start the new graph's workers, and join the old one's when
+            // `fresh` goes, outside the lock
+            std::unique_ptr<AudioGraph> fresh = createGraph(next, true);
+            std::lock_guard<std::mutex> lock(instrumentsMutex);
+            double oldRate = sampleRate.load();
+            {
+                std::lock_guard<std::mutex> settingsLock(settingsMutex);
+                settings = next;
+            }
+            sampleRate.store(next.sampleRate);
+            flushDenormals.store(next.flushDenormals);
+            convertSampleRate(oldRate, next.sampleRate);
+            configured = true;
+            installGraph(fresh, next);
+        }
+    }
+}
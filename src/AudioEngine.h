@@ -0,0 +1,254 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Instrument.h"
+#include "Transport.h"
+#include "AudioGraph.h"
+#include "AudioBackend.h"
+#include "LoadMeter.h"
+#include "WavWriter.h"
+#include "NoteSequence.h"
+#include "Realtime.h"
+#include "UiSnapshot.h"
+
+// Stream configuration, adjustable while the engine is running
+struct AudioSettings {
+    double sampleRate;
+    unsigned long framesPerBuffer;
+    bool lowLatency;   // request the device's low output latency
+    int workerThreads; // graph worker threads, -1 picks from the core count
+    std::string backend;    // "portaudio", "null" or "file"; fixed at start
+    std::string outputFile; // destination of the file backend
+    int realtimePriority;   // SCHED_FIFO priority for the audio thread, 0 leaves it alone
+    bool lockMemory;        // mlockall() at start
+    std::vector<int> audioCpus;  // cores for the audio thread, empty for any
+    std::vector<int> workerCpus; // cores for the graph workers, empty for any
+    std::string recordDirectory; // spool takes to WAV files here, empty keeps them in RAM
+    bool flushDenormals;    // FTZ/DAZ on the audio and worker threads
+    bool dcInjection;       // add a tiny offset inside feedback structures
+
+    AudioSettings()
+        : sampleRate(48000.0), framesPerBuffer(1024), lowLatency(false), workerThreads(-1),
+          backend("portaudio"), realtimePriority(70), lockMemory(false),
+          flushDenormals(true), dcInjection(false) {}
+};
+
+// Outcome of an offline render
+struct OfflineRenderResult {
+    uint64_t frames;    // frames written to the file
+    double wallSeconds; // time the render took
+};
+
+// Owns the instruments, the processing graph and the output stream. All DSP
+// reads the sample rate from here.
+class AudioEngine : public AudioBackend::Client {
+public:
+    AudioEngine();
+    ~AudioEngine();
+
+    AudioEngine(const AudioEngine&) = delete;
+    AudioEngine& operator=(const AudioEngine&) = delete;
+
+    // Apply settings and build the graph without opening a stream; enough
+    // for offline rendering. Throws std::runtime_error while a track is
+    // recording, since its take can't be converted under the stream.
+    void configure(const AudioSettings& settings);
+    // Configure and open the output stream on a dedicated thread
+    void start(const AudioSettings& settings);
+    void stop();
+
+    // Ask the audio thread to close and reopen the stream with new settings.
+    // Voices and recordings are converted to the new sample rate. Throws
+    // std::runtime_error while a track is recording; a take started before
+    // the request is applied is stopped first.
+    void reconfigure(const AudioSettings& settings);
+    bool isReconfiguring() const;
+
+    AudioSettings getSettings() const;
+    double getSampleRate() const;
+    // Output latency reported by the device for the open stream, in seconds
+    double getOutputLatency() const;
+    // Delay added by the graph itself (the limiter lookahead), in seconds
+    double getProcessingLatency() const;
+    // Why the backend could not be created or opened, empty if it is running
+    std::string getBackendError() const;
+    // Scheduling, affinity and memory locking granted to the audio path,
+    // one line per thread
+    std::string getRealtimeReport() const;
+
+    // Create an instrument and wire its source node and send into the graph
+    void addInstrument(const std::string& name);
+    // Add an instrument whose take is an existing mono float WAV file,
+    // played from disk. Throws std::runtime_error if the file can't be used.
+    void addTrack(const std::string& name, const std::string& file);
+
+    // An edit of the instruments, run with instrumentsMutex held
+    typedef std::function<void(AudioEngine&)> Command;
+    // Queue an edit; it runs on the next sync()
+    void post(const Command& command);
+    // Run the queued edits and copy what the editor shows, holding
+    // instrumentsMutex only for that. Called once per UI frame, so a
+    // frame being drawn never keeps the audio thread waiting. Snapshots
+    // are double buffered: keep the result no longer than a frame, or
+    // the next sync() has to allocate a fresh one.
+    std::shared_ptr<const UiSnapshot> sync();
+
+    // Start or release a note on an instrument
+    void noteOn(size_t instrument, int note);
+    void noteOff(size_t instrument, int note);
+
+    // Schedule note events to play sample-accurately from now on. Every
+    // instrument the events refer to must already exist.
+    void setSequence(const std::vector<NoteEvent>& events);
+    // True once every scheduled event has been played
+    bool isSequenceFinished();
+
+    // Render interleaved stereo output; this is the stream callback body.
+    // It only tries instrumentsMutex: a block that finds it held is
+    // silent and counted in loadMeter, so no edit can stall the stream.
+    void render(float* out, unsigned long frames);
+    // Backend entry point: render() with load and xrun accounting
+    void renderAudio(float* out, unsigned long frames, bool xrun) override;
+
+    // Render every recorded track (with its offset, volume and mute) and the
+    // note sequence, from the top, plus `tailSeconds` of effect tail to a
+    // WAV file, as fast as the CPU allows.
+    // Live voices are left out and the stream outputs silence meanwhile.
+    // Throws std::runtime_error if the file cannot be written.
+    OfflineRenderResult renderOffline(const std::string& path, double tailSeconds = 2.0,
+                                      WavWriter::Format format = WavWriter::Float32);
+
+    // All instruments/tracks. A deque keeps element addresses stable so
+    // graph nodes can refer to their instrument while more are added.
+    std::deque<Instrument> instruments;
+    // Protects instruments and their data, and the graph. The audio
+    // thread never waits for it, but each block it is held costs a
+    // dropout, so hold it only to swap in work prepared beforehand.
+    std::mutex instrumentsMutex;
+
+    // Master volume and effect parameters shared with the graph nodes
+    std::atomic<float> volume;
+    std::atomic<float> delaySeconds;
+    std::atomic<float> delayFeedback;
+    // Output limiter: on/off, ceiling (linear) and the lowest gain it
+    // applied in the last block
+    std::atomic<bool> limiterEnabled;
+    std::atomic<float> limiterCeiling;
+    std::atomic<float> limiterGain;
+    // Tempo and loop points for clip playback
+    Transport transport;
+
+    // Master output level, and the master output for the oscilloscope and
+    // spectrum; each instrument has its own meter and ring too
+    LevelMeter masterMeter;
+    ScopeRing masterScope;
+
+    // Callback timing and dropout statistics
+    LoadMeter loadMeter;
+
+private:
+    void audioThread();
+    void setBackendError(const std::string& error);
+    // Record what a thread of the audio path was granted
+    void report(const std::string& thread, const std::string& granted);
+    // Run the graph and interleave its output; instrumentsMutex held
+    void renderBlock(float* out, unsigned long frames);
+    // An empty graph for `s`, with worker threads unless `withWorkers` is
+    // false. Called before taking instrumentsMutex: starting threads (and
+    // joining those of the graph it replaces) can take a while.
+    std::unique_ptr<AudioGraph> createGraph(const AudioSettings& s, bool withWorkers);
+    // Wire `fresh` up and make it the current graph; instrumentsMutex
+    // held. The old graph is left in `fresh`, to be destroyed unlocked.
+    void installGraph(std::unique_ptr<AudioGraph>& fresh, const AudioSettings& s);
+    void addInstrumentNodes(Instrument& inst);
+    // Sequence notes, played by the audio thread in the instrument's
+    // sequence voice pool
+    void startSequenceNote(size_t instrument, int note);
+    void stopSequenceNote(size_t instrument, int note);
+    // Throw std::runtime_error if a track is recording; instrumentsMutex held
+    void checkNotRecording() const;
+    // Convert voices and recordings to a new sample rate, stopping takes
+    // that are still being recorded; instrumentsMutex held
+    void convertSampleRate(double from, double to);
+    // Tops up the record buffers' spare chunks off the audio thread
+    void allocatorThread();
+    // Build the voices note takes have asked for without holding
+    // instrumentsMutex, then install them under it
+    void buildNoteVoices();
+    // Spools recordings to disk and streams spooled takes back for playback
+    void diskThread();
+    // One pass of diskThread(): write, read ahead and evict for every track.
+    // renderOffline() also calls it while the disk thread keeps running.
+    void streamRecordings();
+    // New spool file name for a take on `track`
+    std::string takePath(const std::string& directory, const std::string& track);
+
+    std::thread thread;
+    std::atomic<bool> running;
+
+    // Housekeeping threads that keep allocation and disk I/O off the
+    // audio thread
+    std::thread allocator;
+    std::thread disk;
+    std::atomic<bool> housekeeping;
+    std::mutex housekeepingMutex;
+    std::condition_variable housekeepingWake;
+    std::atomic<unsigned> takeCounter;
+
+    // Edits waiting for sync()
+    std::mutex commandsMutex;
+    std::vector<Command> commands;
+    // sync() fills these in turn, reusing the one the UI is done with
+    std::shared_ptr<UiSnapshot> snapshots[2];
+    int nextSnapshot;
+
+    mutable std::mutex settingsMutex;
+    AudioSettings settings;
+    AudioSettings pendingSettings;
+    std::atomic<bool> reconfigurePending;
+    std::atomic<double> sampleRate;
+    std::atomic<bool> flushDenormals;
+    std::atomic<double> outputLatency;
+    std::atomic<unsigned long> processingLatency; // frames
+    std::string backendError;
+    std::map<std::string, std::string> realtimeReport;
+    // Callback thread of the open stream. renderAudio() only records it;
+    // audioThread() promotes, pins and reports it, so none of that runs in
+    // the callback. States: kThreadUnseen, kThreadSeen, kThreadPromoted.
+    std::atomic<int> callbackThreadState;
+    ThreadId callbackThread;
+    // False until settings are applied; the graph is built without workers
+    // before that, so none start with the default priority and cores
+    std::atomic<bool> configured;
+    // Set while renderOffline() owns the graph
+    std::atomic<bool> offlineRendering;
+
+    // Scheduled note events and the playback position within them, in
+    // samples; protected by instrumentsMutex
+    std::vector<NoteEvent> sequence;
+    size_t sequenceIndex;
+    uint64_t sequencePosition;
+    // Ready-made voices per (instrument, note) for the sequence, copied on
+    // note-on so the audio thread does not rebuild wave tables
+    std::map<std::pair<size_t, int>, Voice> voicePrototypes;
+
+    std::unique_ptr<AudioGraph> graph;
+    std::vector<float> scopeMix; // mid signal of a block for masterScope
+    AudioNode* masterBus;
+    AudioNode* effectsBus;
+};
+
+#endif // AUDIOENGINE_H
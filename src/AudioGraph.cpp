@@ -0,0 +1,614 @@
+#include "AudioGraph.h"
+#include "Instrument.h"
+#include "Transport.h"
+#include "Denormals.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+// Time for a level to travel from silence to full scale, and a pan from
+// the centre to one side. Long enough that rides and mutes don't click,
+// short enough to feel immediate.
+static const float kLevelRampSeconds = 0.02f;
+static const float kPanRampSeconds = 0.05f;
+
+// Largest absolute sample of a block
+static float blockPeak(const float* samples, unsigned long frames)
+{
+    float peak = 0.0f;
+    unsigned long i = 0;
+#if defined(SYNTH_DENORMALS_SSE)
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 peaks = _mm_setzero_ps();
+    for (; i + 4 <= frames; i += 4) {
+        peaks = _mm_max_ps(peaks, _mm_andnot_ps(signBit, _mm_loadu_ps(samples + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, peaks);
+    peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < frames; ++i) {
+        peak = std::max(peak, std::fabs(samples[i]));
+    }
+    return peak;
+}
+
+// ---------------------------------------------------------------------------
+// AudioNode
+
+const int AudioNode::kChannels;
+
+AudioNode::AudioNode(const std::string& name) : maxFrames(0), name(name) {}
+
+AudioNode::~AudioNode() {}
+
+void AudioNode::prepare(unsigned long frames)
+{
+    maxFrames = frames;
+    buffer.assign(kChannels * maxFrames, 0.0f);
+}
+
+const float* AudioNode::output(int c) const
+{
+    return buffer.data() + c * maxFrames;
+}
+
+const std::string& AudioNode::getName() const
+{
+    return name;
+}
+
+void AudioNode::sumInputs(const std::vector<AudioNode*>& inputs, unsigned long frames)
+{
+    for (int c = 0; c < kChannels; ++c) {
+        float* out = channel(c);
+        std::fill(out, out + frames, 0.0f);
+        for (AudioNode* in : inputs) {
+            const float* src = in->output(c);
+            for (unsigned long i = 0; i < frames; ++i) {
+                out[i] += src[i];
+            }
+        }
+    }
+}
+
+// Constant-power pan law with unity gain in the centre, so a centred
+// source plays at the level it had in mono. `pan` runs from -1 (left) to
+// 1 (right).
+static void panGains(float pan, float& left, float& right)
+{
+    const float quarterPi = 0.785398163f;
+    const float sqrt2 = 1.41421356f;
+    float angle = (std::min(std::max(pan, -1.0f), 1.0f) + 1.0f) * quarterPi;
+    left = sqrt2 * std::cos(angle);
+    right = sqrt2 * std::sin(angle);
+}
+
+// Pan a mono block into (or, with `add`, onto) left and right while the
+// position glides from `from` to `to`: one gain pair per block end and a
+// linear ramp between them
+static void panBlock(const float* in, float* left, float* right, unsigned long frames,
+                     float from, float to, bool add)
+{
+    float l0, r0, l1, r1;
+    panGains(from, l0, r0);
+    panGains(to, l1, r1);
+    float dl = (l1 - l0) / frames;
+    float dr = (r1 - r0) / frames;
+    if (add) {
+        for (unsigned long i = 0; i < frames; ++i) {
+            left[i] += in[i] * (l0 + dl * (i + 1));
+            right[i] += in[i] * (r0 + dr * (i + 1));
+        }
+    } else {
+        for (unsigned long i = 0; i < frames; ++i) {
+            left[i] = in[i] * (l0 + dl * (i + 1));
+            right[i] = in[i] * (r0 + dr * (i + 1));
+        }
+    }
+}
+
+// Where a note sits across the keyboard for the stereo spread: -1 two
+// octaves below middle C, 1 two octaves above
+static float keyPosition(int note)
+{
+    return std::min(std::max((note - 60) / 24.0f, -1.0f), 1.0f);
+}
+
+// ---------------------------------------------------------------------------
+// InstrumentNode
+
+InstrumentNode::InstrumentNode(Instrument& instrument, const Transport& transport, double sampleRate)
+    : AudioNode(instrument.name), inst(instrument), transport(transport), sampleRate(sampleRate),
+      level(instrument.mute ? 0.0f : instrument.volume, kLevelRampSeconds),
+      pan(instrument.pan, kPanRampSeconds), spreadWidth(instrument.spread, kPanRampSeconds),
+      fadeFrames(0), fadeDone(0) {}
+
+void InstrumentNode::prepare(unsigned long maxFrames)
+{
+    AudioNode::prepare(maxFrames);
+    dry.assign(maxFrames, 0.0f);
+    scratch.assign(maxFrames, 0.0f);
+    mix.assign(maxFrames, 0.0f);
+    tail.assign(maxFrames, 0.0f);
+}
+
+void InstrumentNode::mixClips(size_t from, size_t frames, float* out, bool withNotes)
+{
+    std::fill(out, out + frames, 0.0f);
+    size_t to = from + frames;
+    // A block copy per audio clip; note clips play through their own voices
+    inst.clipIndex.forEachOverlapping(from, to, [&](const ClipIndex::Entry& e) {
+        const Clip& clip = inst.clips[e.clip];
+        if (clip.notes && !withNotes) return;
+        // The take being recorded is already heard through the live voices
+        if (inst.isRecordingInto(clip)) return;
+        size_t begin = std::max(from, e.start);
+        size_t end = std::min(to, std::min(e.end, e.start + clip.frames()));
+        if (begin >= end) return;
+        float* dst = out + (begin - from);
+        if (clip.notes) {
+            clip.notes->render(begin - e.start, dst, end - begin, clip.gain);
+            return;
+        }
+        clip.take->read(begin - e.start, scratch.data(), end - begin);
+        for (size_t i = 0; i < end - begin; ++i) {
+            dst[i] += scratch[i] * clip.gain;
+        }
+    });
+}
+
+void InstrumentNode::renderVoices(unsigned long frames, bool spread)
+{
+    std::vector<Voice>& pool = inst.sequenceVoices;
+    const std::vector<int>& poolNotes = inst.sequenceNotes;
+    if (!spread) {
+        for (unsigned long i = 0; i < frames; ++i) {
+            float instValue = 0.0f;
+            for (auto &v : inst.voices) {
+                instValue += static_cast<float>(v.osc.getWaveformValue());
+            }
+            for (size_t v = 0; v < pool.size(); ++v) {
+                if (poolNotes[v] >= 0) instValue += static_cast<float>(pool[v].osc.getWaveformValue());
+            }
+            dry[i] = instValue;
+        }
+        return;
+    }
+
+    auto panVoice = [&](Voice& v) {
+        for (unsigned long i = 0; i < frames; ++i) {
+            scratch[i] = static_cast<float>(v.osc.getWaveformValue());
+            dry[i] += scratch[i];
+        }
+        float key = keyPosition(v.note);
+        panBlock(scratch.data(), channel(0), channel(1), frames,
+                 pan.start() + spreadWidth.start() * key, pan.end() + spreadWidth.end() * key, true);
+    };
+    for (auto &v : inst.voices) {
+        panVoice(v);
+    }
+    for (size_t v = 0; v < pool.size(); ++v) {
+        if (poolNotes[v] >= 0) panVoice(pool[v]);
+    }
+}
+
+void InstrumentNode::process(const std::vector<AudioNode*>& inputs, unsigned long frames)
+{
+    (void) inputs;
+
+    // Settings glide over a few blocks instead of jumping
+    level.advance(inst.mute ? 0.0f : inst.volume, frames, sampleRate);
+    pan.advance(inst.pan, frames, sampleRate);
+    spreadWidth.advance(inst.spread, frames, sampleRate);
+    float* left = channel(0);
+    float* right = channel(1);
+
+    // Live voices. With a spread they are panned one by one into the
+    // output and `dry` only keeps their sum for recording.
+    bool spread = (spreadWidth.start() > 0.0f || spreadWidth.end() > 0.0f) &&
+                  (!inst.voices.empty() || inst.sequenceSounding());
+    if (spread) {
+        std::fill(dry.begin(), dry.begin() + frames, 0.0f);
+        std::fill(left, left + frames, 0.0f);
+        std::fill(right, right + frames, 0.0f);
+    }
+    renderVoices(frames, spread);
+
+    // Record raw waveform before applying pan/volume/mute
+    if (inst.isRecording && inst.recordTarget) {
+        inst.recordTarget->append(dry.data(), frames);
+    }
+    if (spread) {
+        std::fill(dry.begin(), dry.begin() + frames, 0.0f);
+    }
+    // A note take only needs the clock its key presses are stamped with
+    if (inst.isRecording && inst.noteTarget) {
+        inst.noteTarget->advance(frames);
+    }
+
+    if (inst.isPlaying) {
+        // Loop points are read once per block, and the block is played in
+        // segments that end at the loop end
+        size_t loopStart = transport.beatToFrame(transport.loopStart.load(std::memory_order_relaxed), sampleRate);
+        size_t loopEnd = transport.beatToFrame(transport.loopEnd.load(std::memory_order_relaxed), sampleRate);
+        bool looping = transport.looping.load(std::memory_order_relaxed) && loopEnd > loopStart;
+        size_t crossfade = static_cast<size_t>(transport.crossfadeSeconds.load(std::memory_order_relaxed) * sampleRate);
+        if (looping) {
+            crossfade = std::min(crossfade, (loopEnd - loopStart) / 2);
+        } else {
+            fadeFrames = 0;
+        }
+
+        size_t pos = inst.playIndex;
+        if (looping && pos >= loopEnd) {
+            pos = loopStart; // the loop was moved behind the playhead
+        }
+        size_t done = 0;
+        while (done < frames) {
+            size_t n = frames - done;
+            if (looping) n = std::min(n, loopEnd - pos);
+            mixClips(pos, n, mix.data(), true);
+
+            // Just after a wrap: fade the loop start in over what would have
+            // followed the loop end
+            if (fadeDone < fadeFrames) {
+                size_t k = std::min(n, fadeFrames - fadeDone);
+                mixClips(loopEnd + fadeDone, k, tail.data(), false);
+                for (size_t i = 0; i < k; ++i) {
+                    float t = static_cast<float>(fadeDone + i) / fadeFrames;
+                    mix[i] = mix[i] * t + tail[i] * (1.0f - t);
+                }
+                fadeDone += k;
+            }
+
+            float* out = dry.data() + done;
+            for (size_t i = 0; i < n; ++i) {
+                out[i] += mix[i];
+            }
+            pos += n;
+            done += n;
+            if (looping && pos == loopEnd) {
+                pos = loopStart;
+                fadeFrames = crossfade;
+                fadeDone = 0;
+            }
+        }
+        inst.playIndex = pos;
+        if (!looping && pos >= inst.clipIndex.end()) {
+            inst.isPlaying = false;
+            inst.playIndex = 0;
+        }
+    }
+
+    // Pan the mono part with one gain pair per block end, then apply the
+    // volume and mute
+    panBlock(dry.data(), left, right, frames, pan.start(), pan.end(), spread);
+    level.apply(left, frames);
+    level.apply(right, frames);
+
+    if (inst.softClip) {
+        // Cubic curve reaching exactly 1 with zero slope at 1.5, so peaks
+        // up to +3.5 dB are rounded off and anything above is held at 1
+        for (int c = 0; c < kChannels; ++c) {
+            float* out = channel(c);
+            for (unsigned long i = 0; i < frames; ++i) {
+                float x = std::min(std::max(out[i], -1.5f), 1.5f);
+                out[i] = x - (4.0f / 27.0f) * x * x * x;
+            }
+        }
+    }
+
+    const float* channels[kChannels] = { left, right };
+    inst.meter.process(channels, kChannels, frames, sampleRate);
+    // The scope shows the mid signal
+    for (unsigned long i = 0; i < frames; ++i) {
+        scratch[i] = 0.5f * (left[i] + right[i]);
+    }
+    inst.scope.write(scratch.data(), frames);
+}
+
+// ---------------------------------------------------------------------------
+// BusNode
+
+BusNode::BusNode(const std::string& name) : AudioNode(name) {}
+
+void BusNode::process(const std::vector<AudioNode*>& inputs, unsigned long frames)
+{
+    sumInputs(inputs, frames);
+}
+
+// ---------------------------------------------------------------------------
+// GainNode
+
+GainNode::GainNode(const std::string& name, const std::atomic<float>& level, double sampleRate)
+    : AudioNode(name), level(level), gain(level.load(), kLevelRampSeconds), sampleRate(sampleRate) {}
+
+void GainNode::process(const std::vector<AudioNode*>& inputs, unsigned long frames)
+{
+    sumInputs(inputs, frames);
+    gain.advance(level.load(std::memory_order_relaxed), frames, sampleRate);
+    for (int c = 0; c < kChannels; ++c) {
+        gain.apply(channel(c), frames);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// DelayNode
+
+DelayNode::DelayNode(const std::string& name, double sampleRate, float maxDelaySeconds,
+                     const std::atomic<float>& delaySeconds, const std::atomic<float>& feedback,
+                     bool dcInjection)
+    : AudioNode(name), delaySeconds(delaySeconds), feedback(feedback),
+      lines(kChannels * (static_cast<size_t>(maxDelaySeconds * sampleRate) + 1), 0.0f),
+      lineLength(static_cast<size_t>(maxDelaySeconds * sampleRate) + 1), writeIndex(0), sampleRate(sampleRate), offset(dcInjection ? kAntiDenormal : 0.0f) {}
+
+void DelayNode::process(const std::vector<AudioNode*>& inputs, unsigned long frames)
+{
+    sumInputs(inputs, frames);
+
+    size_t delay = static_cast<size_t>(delaySeconds.load(std::memory_order_relaxed) * sampleRate);
+    delay = std::min(std::max<size_t>(delay, 1), lineLength - 1);
+    float fb = std::min(std::max(feedback.load(std::memory_order_relaxed), 0.0f), 0.95f);
+
+    size_t start = writeIndex;
+    for (int c = 0; c < kChannels; ++c) {
+        float* out = channel(c);
+        float* line = lines.data() + c * lineLength;
+        writeIndex = start;
+        for (unsigned long i = 0; i < frames; ++i) {
+            size_t readIndex = (writeIndex + lineLength - delay) % lineLength;
+            float delayed = line[readIndex];
+            line[writeIndex] = out[i] + delayed * fb + offset;
+            out[i] = delayed;
+            writeIndex = (writeIndex + 1) % lineLength;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// LimiterNode
+
+LimiterNode::LimiterNode(const std::string& name, double sampleRate, double lookaheadSeconds,
+                         double releaseSeconds, const std::atomic<bool>& enabled,
+                         const std::atomic<float>& ceiling, std::atomic<float>& gainReduction)
+    : AudioNode(name), enabled(enabled), ceiling(ceiling), gainReduction(gainReduction),
+      lookahead(std::max(1ul, static_cast<unsigned long>(lookaheadSeconds * sampleRate + 0.5))),
+      releaseCoeff(static_cast<float>(1.0 - std::exp(-1.0 / (releaseSeconds * sampleRate)))),
+      delayLine(kChannels * lookahead, 0.0f), held(lookahead, 1.0f), heldSum(lookahead),
+      peaks(lookahead + 1), peakFront(0), peakCount(0), index(0), position(0),
+      release(1.0f), settled(lookahead) {}
+
+// Forget any gain reduction in progress
+void LimiterNode::settle()
+{
+    std::fill(held.begin(), held.end(), 1.0f);
+    heldSum = static_cast<double>(lookahead);
+    peakCount = 0;
+    release = 1.0f;
+    settled = lookahead;
+}
+
+void LimiterNode::process(const std::vector<AudioNode*>& inputs, unsigned long frames)
+{
+    sumInputs(inputs, frames);
+
+    float limit = std::min(std::max(ceiling.load(std::memory_order_relaxed), 0.01f), 1.0f);
+    bool on = enabled.load(std::memory_order_relaxed);
+    if (!on && settled < lookahead) settle();
+
+    float* left = channel(0);
+    float* right = channel(1);
+    float* leftLine = delayLine.data();
+    float* rightLine = delayLine.data() + lookahead;
+
+    if (!on || (settled >= lookahead && blockPeak(left, frames) <= limit && blockPeak(right, frames) <= limit)) {
+        // Nothing to limit: just delay, swapping the block through the
+        // lines in at most a few contiguous runs
+        for (unsigned long i = 0; i < frames;) {
+            size_t n = std::min<size_t>(frames - i, lookahead - index);
+            std::swap_ranges(left + i, left + i + n, leftLine + index);
+            std::swap_ranges(right + i, right + i + n, rightLine + index);
+            i += n;
+            index += n;
+            if (index == lookahead) index = 0;
+        }
+        position += frames;
+        gainReduction.store(1.0f, std::memory_order_relaxed);
+        return;
+    }
+
+    const size_t capacity = peaks.size();
+    const double average = 1.0 / lookahead;
+    float lowest = 1.0f;
+    for (unsigned long i = 0; i < frames; ++i, ++position) {
+        float l = left[i];
+        float r = right[i];
+        float level = std::max(std::fabs(l), std::fabs(r));
+        // Drop the request leaving the window before adding this one, so a
+        // long falling edge (every sample a new, smaller request) never
+        // holds more than lookahead + 1 of them
+        if (peakCount > 0 && peaks[peakFront].position + lookahead < position) {
+            // One frame leaves the window per sample, so at most one peak
+            if (++peakFront == capacity) peakFront = 0;
+            --peakCount;
+        }
+        if (level > limit) {
+            // Requests that ask for less reduction than this one and end
+            // before it can never be the lowest again
+            float gain = limit / level;
+            while (peakCount > 0) {
+                size_t last = peakFront + peakCount - 1;
+                if (last >= capacity) last -= capacity;
+                if (peaks[last].gain < gain) break;
+                --peakCount;
+            }
+            size_t slot = peakFront + peakCount;
+            if (slot >= capacity) slot -= capacity;
+            peaks[slot].position = position;
+            peaks[slot].gain = gain;
+            ++peakCount;
+        }
+
+        float target = peakCount > 0 ? peaks[peakFront].gain : 1.0f;
+        release = std::min(target, release + (1.0f - release) * releaseCoeff);
+        if (release > 0.999999f) release = 1.0f;
+        settled = release == 1.0f ? settled + 1 : 0;
+
+        heldSum += release - held[index];
+        held[index] = release;
+        float g = static_cast<float>(heldSum * average);
+        lowest = std::min(lowest, g);
+
+        left[i] = leftLine[index] * g;
+        right[i] = rightLine[index] * g;
+        leftLine[index] = l;
+        rightLine[index] = r;
+        if (++index == lookahead) index = 0;
+    }
+    // Every held gain is back at 1; drop the rounding the sum picked up
+    if (settled >= lookahead) heldSum = static_cast<double>(lookahead);
+    gainReduction.store(lowest, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// AudioGraph
+
+AudioGraph::AudioGraph(unsigned long maxFrames, unsigned workerThreads,
+                       std::function<void(unsigned)> onWorkerStart)
+    : outputNode(nullptr), maxFrames(maxFrames), current(nullptr),
+      pending(nullptr), retired(nullptr)
+{
+    if (workerThreads > 0) {
+        workers.reset(new WorkerPool(workerThreads, onWorkerStart));
+    }
+}
+
+AudioGraph::~AudioGraph()
+{
+    // The audio thread must no longer be calling process()
+    delete current;
+    delete pending.exchange(nullptr);
+    delete retired.exchange(nullptr);
+}
+
+AudioNode* AudioGraph::addNode(std::unique_ptr<AudioNode> node)
+{
+    node->prepare(maxFrames);
+    nodes.push_back(std::move(node));
+    return nodes.back().get();
+}
+
+void AudioGraph::connect(AudioNode* from, AudioNode* to)
+{
+    edges.emplace_back(from, to);
+}
+
+void AudioGraph::setOutput(AudioNode* node)
+{
+    outputNode = node;
+}
+
+bool AudioGraph::compile()
+{
+    // Free whatever the audio thread has let go of since the last compile
+    delete retired.exchange(nullptr);
+
+    if (!outputNode) return false;
+
+    std::map<AudioNode*, std::vector<AudioNode*>> inputsOf;
+    for (auto &e : edges) {
+        inputsOf[e.second].push_back(e.first);
+    }
+
+    // Depth-first walk from the output: a node's level is one more than the
+    // deepest of its inputs. Nodes that do not feed the output are skipped.
+    std::map<AudioNode*, int> level;
+    std::map<AudioNode*, int> state; // 1 = visiting, 2 = done
+    std::vector<std::pair<AudioNode*, size_t>> stack;
+    stack.emplace_back(outputNode, 0);
+    state[outputNode] = 1;
+    while (!stack.empty()) {
+        AudioNode* node = stack.back().first;
+        size_t& next = stack.back().second;
+        std::vector<AudioNode*>& ins = inputsOf[node];
+        if (next < ins.size()) {
+            AudioNode* in = ins[next++];
+            int s = state[in];
+            if (s == 1) return false; // cycle
+            if (s == 0) {
+                state[in] = 1;
+                stack.emplace_back(in, 0);
+            }
+            continue;
+        }
+        int depth = 0;
+        for (AudioNode* in : ins) {
+            depth = std::max(depth, level[in] + 1);
+        }
+        level[node] = depth;
+        state[node] = 2;
+        stack.pop_back();
+    }
+
+    Schedule* schedule = new Schedule();
+    schedule->output = outputNode;
+    schedule->levels.resize(level[outputNode] + 1);
+    // Walk nodes in insertion order so the schedule is deterministic
+    for (auto &n : nodes) {
+        auto it = level.find(n.get());
+        if (it == level.end()) continue;
+        Entry entry;
+        entry.node = n.get();
+        entry.inputs = inputsOf[n.get()];
+        schedule->levels[it->second].push_back(entry);
+    }
+
+    // A schedule the audio thread never picked up can be freed right away
+    delete pending.exchange(schedule);
+    return true;
+}
+
+void AudioGraph::runEntry(void* task, size_t index)
+{
+    LevelTask* t = static_cast<LevelTask*>(task);
+    Entry& e = (*t->level)[index];
+    e.node->process(e.inputs, t->frames);
+}
+
+const AudioNode* AudioGraph::process(unsigned long frames)
+{
+    // Only swap once the previous retired schedule has been collected, so a
+    // schedule is never freed while this thread could still be using it
+    if (retired.load(std::memory_order_acquire) == nullptr) {
+        Schedule* next = pending.exchange(nullptr, std::memory_order_acq_rel);
+        if (next) {
+            retired.store(current, std::memory_order_release);
+            current = next;
+        }
+    }
+    if (!current) return nullptr;
+
+    frames = std::min(frames, maxFrames);
+    for (auto &level : current->levels) {
+        if (workers && level.size() > 1) {
+            LevelTask task = { &level, frames };
+            workers->run(&AudioGraph::runEntry, &task, level.size());
+        } else {
+            for (auto &e : level) {
+                e.node->process(e.inputs, frames);
+            }
+        }
+    }
+    return current->output;
+}
+
+unsigned long AudioGraph::getMaxFrames() const
+{
+    return maxFrames;
+}
+
+unsigned AudioGraph::getWorkerCount() const
+{
+    return workers ? workers->size() : 0;
+}
@@ -0,0 +1,235 @@
+#ifndef AUDIOGRAPH_H
+#define AUDIOGRAPH_H
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "WorkerPool.h"
+#include "SmoothedValue.h"
+
+struct Instrument;
+struct Transport;
+
+// A processing node in the audio graph. Every node renders one block of
+// kChannels planar channels into its own buffer; inputs are summed by the
+// node itself so sources, effects and buses share the same interface.
+class AudioNode {
+public:
+    static const int kChannels = 2;
+
+    explicit AudioNode(const std::string& name);
+    virtual ~AudioNode();
+
+    // Render `frames` samples into the output buffer. All inputs have
+    // already been processed for this block when this is called.
+    virtual void process(const std::vector<AudioNode*>& inputs, unsigned long frames) = 0;
+
+    // Allocate the output buffers; never called from the audio thread
+    virtual void prepare(unsigned long maxFrames);
+    // Frames by which the node delays its input
+    virtual unsigned long latency() const { return 0; }
+
+    const float* output(int channel) const;
+    const std::string& getName() const;
+
+protected:
+    // Write the sum of all inputs into the output buffers
+    void sumInputs(const std::vector<AudioNode*>& inputs, unsigned long frames);
+    float* channel(int c) { return buffer.data() + c * maxFrames; }
+
+    // Channel c occupies [c * maxFrames, (c + 1) * maxFrames)
+    std::vector<float> buffer;
+    unsigned long maxFrames;
+
+private:
+    std::string name;
+};
+
+// Source node: live voices and recorded clip playback of one instrument,
+// panned into stereo. Voices and clips are rendered in mono and panned
+// with one gain pair per block; only with a stereo spread does each voice
+// get a gain pair of its own. With the transport looping, playback wraps from the loop end to the loop
+// start inside the block, and the first moments after the wrap are blended
+// with what follows the loop end so the seam doesn't click.
+class InstrumentNode : public AudioNode {
+public:
+    InstrumentNode(Instrument& instrument, const Transport& transport, double sampleRate);
+    void prepare(unsigned long maxFrames) override;
+    void process(const std::vector<AudioNode*>& inputs, unsigned long frames) override;
+
+private:
+    // Write the clips covering timeline frames [from, from + frames) to
+    // `out`. Note clips are left out of `withNotes` = false renders, since
+    // their voices can only play forward.
+    void mixClips(size_t from, size_t frames, float* out, bool withNotes);
+    // Write the live voices to `dry`, or with a stereo spread, add each at
+    // its own position to the output channels and to `dry`
+    void renderVoices(unsigned long frames, bool spread);
+
+    Instrument& inst;
+    const Transport& transport;
+    double sampleRate;
+    SmoothedValue level;        // volume, 0 while muted
+    SmoothedValue pan;
+    SmoothedValue spreadWidth;
+    std::vector<float> dry;     // the instrument in mono, before panning
+    std::vector<float> scratch; // one clip's samples for a segment
+    std::vector<float> mix;     // clips for a segment
+    std::vector<float> tail;    // material past the loop end, for the crossfade
+    size_t fadeFrames;          // length of the current crossfade
+    size_t fadeDone;            // frames of it already played
+};
+
+// Sums all inputs; used for the master and effect buses
+class BusNode : public AudioNode {
+public:
+    explicit BusNode(const std::string& name);
+    void process(const std::vector<AudioNode*>& inputs, unsigned long frames) override;
+};
+
+// Scales the sum of its inputs by an externally owned level, gliding to
+// new settings. Sends and the master fader are gain nodes.
+class GainNode : public AudioNode {
+public:
+    GainNode(const std::string& name, const std::atomic<float>& level, double sampleRate);
+    void process(const std::vector<AudioNode*>& inputs, unsigned long frames) override;
+
+private:
+    const std::atomic<float>& level;
+    SmoothedValue gain;
+    double sampleRate;
+};
+
+// Feedback delay effect, one line per channel, outputs only the wet
+// signal. Time and feedback are owned by the engine so they survive graph
+// rebuilds. With `dcInjection`
+// a tiny offset keeps the decaying feedback line out of subnormal range.
+class DelayNode : public AudioNode {
+public:
+    DelayNode(const std::string& name, double sampleRate, float maxDelaySeconds,
+              const std::atomic<float>& delaySeconds, const std::atomic<float>& feedback,
+              bool dcInjection = false);
+    void process(const std::vector<AudioNode*>& inputs, unsigned long frames) override;
+
+private:
+    const std::atomic<float>& delaySeconds;
+    const std::atomic<float>& feedback;
+    std::vector<float> lines;   // kChannels lines of lineLength
+    size_t lineLength;
+    size_t writeIndex;
+    double sampleRate;
+    float offset;
+};
+
+// Lookahead brickwall limiter. The signal is delayed by the lookahead so
+// the gain can be lowered before a peak arrives: each sample over the
+// ceiling asks for a gain, the lowest request within the lookahead is
+// held, released exponentially and then averaged over the lookahead,
+// which ramps the gain down smoothly and still has it low enough by the
+// time the peak plays. Detection is linked across channels, so the stereo
+// image does not shift. Blocks that stay under the ceiling while no gain
+// reduction is active are only delayed. Switched off, the node still
+// delays, so latency does not change with the switch.
+class LimiterNode : public AudioNode {
+public:
+    LimiterNode(const std::string& name, double sampleRate, double lookaheadSeconds,
+                double releaseSeconds, const std::atomic<bool>& enabled,
+                const std::atomic<float>& ceiling, std::atomic<float>& gainReduction);
+    void process(const std::vector<AudioNode*>& inputs, unsigned long frames) override;
+    unsigned long latency() const override { return lookahead; }
+
+private:
+    // A sample over the ceiling and the gain it needs
+    struct Peak {
+        uint64_t position;
+        float gain;
+    };
+
+    void settle();
+
+    const std::atomic<bool>& enabled;
+    const std::atomic<float>& ceiling;     // linear
+    std::atomic<float>& gainReduction;     // lowest gain of the last block
+    unsigned long lookahead;
+    float releaseCoeff;
+    std::vector<float> delayLine;          // lookahead frames per channel
+    std::vector<float> held;               // held gain per delayed frame
+    double heldSum;
+    std::vector<Peak> peaks;               // increasing gains, oldest first
+    size_t peakFront;
+    size_t peakCount;
+    size_t index;                          // into delayLine and held
+    uint64_t position;                     // frames processed
+    float release;                         // held gain after release
+    size_t settled;                        // frames since release reached 1
+};
+
+// Owns the nodes and their connections. Edits happen on a control thread and
+// are published to the audio thread by compile(), which computes the
+// topological ordering off the audio thread.
+class AudioGraph {
+public:
+    AudioGraph(unsigned long maxFrames, unsigned workerThreads,
+               std::function<void(unsigned)> onWorkerStart = std::function<void(unsigned)>());
+    ~AudioGraph();
+
+    AudioGraph(const AudioGraph&) = delete;
+    AudioGraph& operator=(const AudioGraph&) = delete;
+
+    // Takes ownership of the node and returns it for connecting
+    AudioNode* addNode(std::unique_ptr<AudioNode> node);
+    void connect(AudioNode* from, AudioNode* to);
+    void setOutput(AudioNode* node);
+
+    // Rebuild the schedule and hand it to the audio thread. Returns false
+    // (leaving the previous schedule active) if the graph has a cycle.
+    bool compile();
+
+    // Audio thread: render one block of at most maxFrames samples and
+    // return the output node, or nullptr if nothing is scheduled.
+    const AudioNode* process(unsigned long frames);
+
+    unsigned long getMaxFrames() const;
+    unsigned getWorkerCount() const;
+
+private:
+    struct Entry {
+        AudioNode* node;
+        std::vector<AudioNode*> inputs;
+    };
+
+    // Nodes grouped by dependency depth. Nodes within a level only depend
+    // on earlier levels and can run concurrently.
+    struct Schedule {
+        std::vector<std::vector<Entry>> levels;
+        AudioNode* output;
+    };
+
+    struct LevelTask {
+        std::vector<Entry>* level;
+        unsigned long frames;
+    };
+
+    static void runEntry(void* task, size_t index);
+
+    std::vector<std::unique_ptr<AudioNode>> nodes;
+    std::vector<std::pair<AudioNode*, AudioNode*>> edges;
+    AudioNode* outputNode;
+    unsigned long maxFrames;
+
+    // Audio thread picks up `pending` at the start of a block; the schedule
+    // it replaces is parked in `retired` and freed by the next compile()
+    Schedule* current;
+    std::atomic<Schedule*> pending;
+    std::atomic<Schedule*> retired;
+
+    std::unique_ptr<WorkerPool> workers;
+};
+
+#endif // AUDIOGRAPH_H
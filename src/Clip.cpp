@@ -0,0 +1,34 @@
+#include "Clip.h"
+#include <algorithm>
+#include <limits>
+
+ClipIndex::ClipIndex() : lastEnd(0) {}
+
+void ClipIndex::build(const std::vector<Clip>& clips, double sampleRate, const void* open)
+{
+    entries.clear();
+    for (size_t i = 0; i < clips.size(); ++i) {
+        Entry e;
+        e.start = static_cast<size_t>(clips[i].start * sampleRate);
+        const void* take = clips[i].take ? static_cast<const void*>(clips[i].take.get())
+                                         : static_cast<const void*>(clips[i].notes.get());
+        e.end = take == open ? std::numeric_limits<size_t>::max() : e.start + clips[i].frames();
+        e.clip = i;
+        entries.push_back(e);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b){ return a.start < b.start; });
+
+    maxEnd.resize(entries.size());
+    lastEnd = buildSubtree(0, entries.size());
+}
+
+size_t ClipIndex::buildSubtree(size_t first, size_t last)
+{
+    if (first >= last) return 0;
+    size_t root = first + (last - first) / 2;
+    size_t end = std::max(entries[root].end,
+                          std::max(buildSubtree(first, root), buildSubtree(root + 1, last)));
+    maxEnd[root] = end;
+    return end;
+}
@@ -0,0 +1,84 @@
+#ifndef CLIP_H
+#define CLIP_H
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "NoteTake.h"
+#include "RecordBuffer.h"
+
+// A recorded take placed on a track's timeline: either audio or note
+// events. The take is shared so the allocator and disk threads can keep
+// working on it after the clip is deleted.
+struct Clip {
+    std::shared_ptr<RecordBuffer> take;  // null for a note clip
+    std::shared_ptr<NoteTake> notes;     // null for an audio clip
+    double start; // seconds from the start of the timeline
+    float gain;
+
+    Clip() : take(RecordBuffer::create()), start(0.0), gain(1.0f) {}
+    explicit Clip(const std::shared_ptr<NoteTake>& notes) : notes(notes), start(0.0), gain(1.0f) {}
+
+    // Length in frames
+    size_t frames() const { return take ? take->size() : notes->frames(); }
+};
+
+// Finds the clips that overlap a range of timeline frames. Entries are
+// sorted by start and read as an implicit balanced binary tree (the middle
+// entry of a range is the root of that range), and every entry also keeps
+// the latest end in its subtree. A query skips each subtree that ends
+// before the range or starts after it, so one long clip no longer makes
+// every later clip a candidate. Built on a control thread whenever clips
+// change; queries don't allocate.
+class ClipIndex {
+public:
+    struct Entry {
+        size_t start; // frames
+        size_t end;   // frames, exclusive
+        size_t clip;  // index into the track's clips
+    };
+
+    ClipIndex();
+
+    // `open` is the take of a clip that is still being recorded; it is
+    // treated as never ending
+    void build(const std::vector<Clip>& clips, double sampleRate, const void* open = nullptr);
+
+    // Call f(entry) for every clip overlapping [from, to), in start order
+    template <typename F>
+    void forEachOverlapping(size_t from, size_t to, F f) const
+    {
+        visit(0, entries.size(), from, to, f);
+    }
+
+    // End of the last clip, 0 without clips
+    size_t end() const { return lastEnd; }
+
+private:
+    // Fill maxEnd for the subtree over entries [first, last) and return
+    // its latest end
+    size_t buildSubtree(size_t first, size_t last);
+
+    // In-order walk of the subtree over [first, last), pruned by the query
+    template <typename F>
+    void visit(size_t first, size_t last, size_t from, size_t to, F& f) const
+    {
+        while (first < last) {
+            size_t root = first + (last - first) / 2;
+            if (maxEnd[root] <= from) return; // the whole subtree ends before
+            visit(first, root, from, to, f);
+            if (entries[root].start >= to) return; // so does everything after
+            if (entries[root].end > from) f(entries[root]);
+            first = root + 1;
+        }
+    }
+
+    std::vector<Entry> entries;
+    std::vector<size_t> maxEnd; // latest end in the subtree rooted at each entry
+    size_t lastEnd;
+};
+
+#endif // CLIP_H
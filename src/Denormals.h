@@ -0,0 +1,71 @@
+#ifndef DENORMALS_H
+#define DENORMALS_H
+
+#pragma once
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SYNTH_DENORMALS_SSE 1
+#elif defined(__aarch64__)
+#include <cstdint>
+#define SYNTH_DENORMALS_ARM64 1
+#endif
+
+// Offset added inside recursive structures (feedback lines, filters) when DC
+// injection is enabled, so their state never decays into the subnormal
+// range. Far below anything audible.
+static const float kAntiDenormal = 1e-20f;
+
+// Enables flush-to-zero and denormals-are-zero for the calling thread while
+// in scope. Subnormal floats are tens of times slower on x86, which is
+// what decaying tails turn into.
+class ScopedNoDenormals {
+public:
+    explicit ScopedNoDenormals(bool enable = true) : saved(0), active(enable)
+    {
+        if (!active) return;
+#if defined(SYNTH_DENORMALS_SSE)
+        saved = _mm_getcsr();
+        _mm_setcsr(saved | 0x8040); // FTZ | DAZ
+#elif defined(SYNTH_DENORMALS_ARM64)
+        uint64_t fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        saved = fpcr;
+        fpcr |= (1ull << 24); // FZ
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#endif
+    }
+
+    ~ScopedNoDenormals()
+    {
+        if (!active) return;
+#if defined(SYNTH_DENORMALS_SSE)
+        _mm_setcsr(static_cast<unsigned>(saved));
+#elif defined(SYNTH_DENORMALS_ARM64)
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(saved));
+#endif
+    }
+
+    ScopedNoDenormals(const ScopedNoDenormals&) = delete;
+    ScopedNoDenormals& operator=(const ScopedNoDenormals&) = delete;
+
+private:
+    unsigned long long saved;
+    bool active;
+};
+
+// Enable flush-to-zero for the rest of the calling thread's life; used for
+// threads that only ever run DSP
+inline void disableDenormalsForThread()
+{
+#if defined(SYNTH_DENORMALS_SSE)
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+#elif defined(SYNTH_DENORMALS_ARM64)
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr |= (1ull << 24);
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#endif
+}
+
+#endif // DENORMALS_H
@@ -0,0 +1,93 @@
+#include "Instrument.h"
+#include <algorithm>
+
+void Instrument::startTake(double start, double sampleRate)
+{
+    if (isRecording) stopTake(sampleRate);
+    if (recordNotes) {
+        Clip clip(std::make_shared<NoteTake>(waveform));
+        clip.start = start;
+        clip.notes->start(sampleRate);
+        noteTarget = clip.notes.get();
+        clips.push_back(clip);
+    } else {
+        Clip clip;
+        clip.start = start;
+        // Spare chunks must be there before the first block arrives
+        clip.take->refill();
+        recordTarget = clip.take.get();
+        clips.push_back(clip);
+    }
+    isRecording = true;
+    reindex(sampleRate);
+}
+
+void Instrument::stopTake(double sampleRate)
+{
+    isRecording = false;
+    if (recordTarget) {
+        recordTarget->releaseSpares();
+        RecordBuffer* take = recordTarget;
+        recordTarget = nullptr;
+        clips.erase(std::remove_if(clips.begin(), clips.end(), [take](const Clip& c) {
+                        return c.take.get() == take && take->empty();
+                    }),
+                    clips.end());
+    }
+    if (noteTarget) {
+        noteTarget->finish(sampleRate);
+        NoteTake* take = noteTarget;
+        noteTarget = nullptr;
+        clips.erase(std::remove_if(clips.begin(), clips.end(), [take](const Clip& c) {
+                        return c.notes.get() == take && take->empty();
+                    }),
+                    clips.end());
+    }
+    reindex(sampleRate);
+}
+
+void Instrument::recordNote(int note, bool on)
+{
+    if (isRecording && noteTarget) noteTarget->record(note, on);
+}
+
+void Instrument::clearClips(double sampleRate)
+{
+    isRecording = false;
+    isPlaying = false;
+    recordTarget = nullptr;
+    noteTarget = nullptr;
+    playIndex = 0;
+    clips.clear();
+    reindex(sampleRate);
+}
+
+void Instrument::reindex(double sampleRate)
+{
+    const void* open = nullptr;
+    if (isRecording) open = recordTarget ? static_cast<const void*>(recordTarget) : noteTarget;
+    clipIndex.build(clips, sampleRate, open);
+}
+
+bool Instrument::isRecordingInto(const Clip& clip) const
+{
+    return isRecording && ((clip.take && clip.take.get() == recordTarget) ||
+                           (clip.notes && clip.notes.get() == noteTarget));
+}
+
+bool Instrument::sequenceSounding() const
+{
+    for (int note : sequenceNotes) {
+        if (note >= 0) return true;
+    }
+    return false;
+}
+
+double Instrument::length(double sampleRate) const
+{
+    double end = 0.0;
+    for (const Clip& c : clips) {
+        end = std::max(end, c.start + c.frames() / sampleRate);
+    }
+    return end;
+}
@@ -0,0 +1,65 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#pragma once
+
+#include "Clip.h"
+#include "LevelMeter.h"
+#include "ScopeRing.h"
+#include "Voice.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Simple instrument/track container
+struct Instrument {
+    std::string name;
+    std::string waveform;
+    std::vector<Voice> voices;
+    // Fixed voice pool for the note sequence, built by setSequence() so the
+    // audio thread starts and stops notes without allocating
+    std::vector<Voice> sequenceVoices;
+    std::vector<int> sequenceNotes; // note per pool slot, -1 when free
+    std::vector<Clip> clips;     // recorded takes on the timeline
+    ClipIndex clipIndex;         // rebuilt by reindex() after clip edits
+    RecordBuffer* recordTarget;  // audio take being recorded, owned by a clip
+    NoteTake* noteTarget;        // note take being recorded, owned by a clip
+    bool recordNotes;            // record note events instead of audio
+    size_t playIndex;            // timeline position in frames
+    bool isRecording;
+    bool isPlaying;
+    float volume;        // per-track volume
+    float pan;           // -1 (left) to 1 (right), constant power
+    float spread;        // 0 to 1: voices panned across the field by key
+    bool mute;           // track mute state
+    bool softClip;       // saturate smoothly instead of passing overs on
+    std::atomic<float> sendLevel; // post-fader level into the effects bus
+    LevelMeter meter;    // post-fader level
+    ScopeRing scope;     // post-fader output for the oscilloscope and spectrum
+
+    Instrument(const std::string& n)
+        : name(n), waveform("sine"), recordTarget(nullptr), noteTarget(nullptr),
+          recordNotes(false), playIndex(0),
+          isRecording(false), isPlaying(false),
+          volume(1.0f), pan(0.0f), spread(0.0f), mute(false), softClip(false), sendLevel(0.0f) {}
+
+    // Clip editing; control thread with instrumentsMutex held.
+    // Start recording into a new clip at `start` seconds
+    void startTake(double start, double sampleRate);
+    // Stop recording; an empty take is discarded. A finished note take
+    // asks for its voices, which the engine builds off the lock.
+    void stopTake(double sampleRate);
+    void clearClips(double sampleRate);
+    // Record a key press into the note take, if one is recording
+    void recordNote(int note, bool on);
+    // Rebuild clipIndex after clips were added, moved or resized
+    void reindex(double sampleRate);
+    // True if `clip` holds the take being recorded
+    bool isRecordingInto(const Clip& clip) const;
+    // True while a sequence note is sounding
+    bool sequenceSounding() const;
+    // End of the last clip in seconds
+    double length(double sampleRate) const;
+};
+
+#endif // INSTRUMENT_H
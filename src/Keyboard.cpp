@@ -3,10 +3,6 @@
 #include <GLFW/glfw3.h>
 #include <algorithm>
 
-// Constants for constructing voices
-static const unsigned kTableSize = 200;
-static const double kSampleRate = 48000.0;
-
 int octave = 0;
 
 // Map of keys to MIDI notes for one octave starting at C4
@@ -25,23 +21,23 @@ static const KeyMap keyMap[] = {
 };
 
 void Keyboard(GLFWwindow* window, std::vector<Voice>& voices, std::mutex& voiceMutex,
-              std::atomic<bool>& keyPressed, const std::string& waveform) {
+              std::atomic<bool>& keyPressed, const std::string& waveform, double sampleRate,
+              const std::function<void(int note, bool on)>& onNote) {
     static bool keysDownPrev[GLFW_KEY_LAST] = {false};
 
-    glfwPollEvents();
-
     for (const auto& km : keyMap) {
         bool isDown = glfwGetKey(window, km.key) == GLFW_PRESS;
         bool wasDown = keysDownPrev[km.key];
         int note = km.note + octave * 12;
 
         if (isDown && !wasDown) {
-            Voice v(kTableSize, kSampleRate);
+            Voice v(kVoiceTableSize, sampleRate);
             v.note = note;
             v.osc.setWaveform(waveform);
             v.osc.setNote(note);
             std::lock_guard<std::mutex> lock(voiceMutex);
             voices.push_back(std::move(v));
+            if (onNote) onNote(note, true);
             keysDownPrev[km.key] = true;
         }
         if (!isDown && wasDown) {
@@ -49,6 +45,7 @@ void Keyboard(GLFWwindow* window, std::vector<Voice>& voices, std::mutex& voiceM
             voices.erase(std::remove_if(voices.begin(), voices.end(),
                                         [note](const Voice& v){ return v.note == note; }),
                           voices.end());
+            if (onNote) onNote(note, false);
             keysDownPrev[km.key] = false;
         }
     }
@@ -3,23 +3,21 @@
 
 #pragma once
 
-#include "Oscillator.h"
+#include "Voice.h"
 #include <GLFW/glfw3.h>
 #include <atomic>
+#include <functional>
 #include <vector>
 #include <mutex>
 #include <string>
 
-// Simple container for a single playing voice
-struct Voice {
-    Oscillator osc;
-    int note;
-    Voice(unsigned tableSize, double sampleRate) : osc(tableSize, sampleRate), note(0) {}
-};
-
-// Function for handling keyboard input for notes
+// Function for handling keyboard input for notes; new voices are created
+// at the engine's current sample rate. Reads the key state left by the
+// caller's last event poll. onNote, if set, is told about every press and
+// release while voiceMutex is held.
 void Keyboard(GLFWwindow* window, std::vector<Voice>& voices, std::mutex& voiceMutex,
-              std::atomic<bool>& keyPressed, const std::string& waveform);
+              std::atomic<bool>& keyPressed, const std::string& waveform, double sampleRate,
+              const std::function<void(int note, bool on)>& onNote = nullptr);
 
 // Callback function for handling octave change keys only
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -0,0 +1,102 @@
+#include "LevelMeter.h"
+#include "Denormals.h"
+#include <algorithm>
+#include <cmath>
+
+const float LevelMeter::kFallDbPerSecond = 20.0f;
+const float LevelMeter::kRmsSeconds = 0.3f;
+const float LevelMeter::kHoldSeconds = 1.5f;
+
+// Levels below this (-140 dB) are dropped to zero so the decaying state
+// never turns subnormal
+static const float kFloor = 1e-7f;
+
+LevelMeter::LevelMeter()
+    : peak(0.0f), rms(0.0f), hold(0.0f), clips(0), resetRequested(false),
+      meanSquare(0.0f), holdFrames(0), cachedFrames(0), cachedRate(0.0), fall(0.0f), rmsWeight(0.0f) {}
+
+void LevelMeter::updateCoefficients(size_t frames, double sampleRate)
+{
+    double seconds = frames / sampleRate;
+    fall = static_cast<float>(std::pow(10.0, -kFallDbPerSecond * seconds / 20.0));
+    rmsWeight = static_cast<float>(1.0 - std::exp(-seconds / kRmsSeconds));
+    cachedFrames = frames;
+    cachedRate = sampleRate;
+}
+
+// Largest absolute sample and sum of squares of a block
+static void measure(const float* samples, size_t frames, float& blockPeak, float& sum)
+{
+    size_t i = 0;
+#if defined(SYNTH_DENORMALS_SSE)
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 peaks = _mm_setzero_ps(), sums = _mm_setzero_ps();
+    for (; i + 4 <= frames; i += 4) {
+        __m128 x = _mm_loadu_ps(samples + i);
+        peaks = _mm_max_ps(peaks, _mm_andnot_ps(signBit, x));
+        sums = _mm_add_ps(sums, _mm_mul_ps(x, x));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, peaks);
+    blockPeak = std::max(blockPeak, std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3])));
+    _mm_storeu_ps(lanes, sums);
+    sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < frames; ++i) {
+        blockPeak = std::max(blockPeak, std::fabs(samples[i]));
+        sum += samples[i] * samples[i];
+    }
+}
+
+void LevelMeter::process(const float* const* channels, int count, size_t frames, double sampleRate)
+{
+    if (frames == 0 || count == 0) return;
+    // Blocks are the same size almost always, so this rarely runs
+    if (frames != cachedFrames || sampleRate != cachedRate) updateCoefficients(frames, sampleRate);
+
+    float blockPeak = 0.0f, sum = 0.0f;
+    for (int c = 0; c < count; ++c) {
+        measure(channels[c], frames, blockPeak, sum);
+    }
+
+    float level = peak.load(std::memory_order_relaxed) * fall;
+    if (blockPeak > level) level = blockPeak;
+    if (level < kFloor) level = 0.0f;
+    peak.store(level, std::memory_order_relaxed);
+
+    meanSquare += (sum / (frames * count) - meanSquare) * rmsWeight;
+    if (meanSquare < kFloor * kFloor) meanSquare = 0.0f;
+    rms.store(std::sqrt(meanSquare), std::memory_order_relaxed);
+
+    float held = hold.load(std::memory_order_relaxed);
+    if (blockPeak >= held || holdFrames <= frames) {
+        held = std::max(blockPeak, level);
+        holdFrames = static_cast<size_t>(kHoldSeconds * sampleRate);
+    } else {
+        holdFrames -= frames;
+    }
+    hold.store(held, std::memory_order_relaxed);
+
+    unsigned clipped = clips.load(std::memory_order_relaxed);
+    if (resetRequested.load(std::memory_order_relaxed) &&
+        resetRequested.exchange(false, std::memory_order_acq_rel)) {
+        clipped = 0;
+    }
+    if (blockPeak >= 1.0f) ++clipped;
+    clips.store(clipped, std::memory_order_relaxed);
+}
+
+LevelMeter::Reading LevelMeter::read() const
+{
+    Reading r;
+    r.peak = peak.load(std::memory_order_relaxed);
+    r.rms = rms.load(std::memory_order_relaxed);
+    r.hold = hold.load(std::memory_order_relaxed);
+    r.clips = clips.load(std::memory_order_relaxed);
+    return r;
+}
+
+void LevelMeter::resetClips()
+{
+    resetRequested.store(true, std::memory_order_release);
+}
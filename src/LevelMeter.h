@@ -0,0 +1,58 @@
+#ifndef LEVELMETER_H
+#define LEVELMETER_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Peak/RMS level meter with a held peak and a clip indicator. The audio
+// thread measures each block it renders (four samples at a time where SSE
+// is available) and stores the results in atomics; the UI reads them
+// whenever it draws. Like LoadMeter, a reader may see values from two
+// different blocks, never a broken one.
+class LevelMeter {
+public:
+    struct Reading {
+        float peak;     // linear, falls back at kFallDbPerSecond
+        float rms;      // linear, averaged over about kRmsSeconds
+        float hold;     // highest peak of the last kHoldSeconds
+        unsigned clips; // blocks with a sample at or beyond full scale since resetClips()
+    };
+
+    static const float kFallDbPerSecond;
+    static const float kRmsSeconds;
+    static const float kHoldSeconds;
+
+    LevelMeter();
+
+    LevelMeter(const LevelMeter&) = delete;
+    LevelMeter& operator=(const LevelMeter&) = delete;
+
+    // Audio thread: measure a block of output. Peaks are the loudest of
+    // the channels and RMS their average power.
+    void process(const float* const* channels, int count, size_t frames, double sampleRate);
+
+    Reading read() const;
+    // Clear the clip indicator; takes effect on the next block
+    void resetClips();
+
+private:
+    void updateCoefficients(size_t frames, double sampleRate);
+
+    std::atomic<float> peak;
+    std::atomic<float> rms;
+    std::atomic<float> hold;
+    std::atomic<unsigned> clips;
+    std::atomic<bool> resetRequested;
+
+    // Audio thread only
+    float meanSquare;
+    size_t holdFrames;    // left until the held peak falls back
+    size_t cachedFrames;  // block size and rate the coefficients are for
+    double cachedRate;
+    float fall;           // peak multiplier per block
+    float rmsWeight;      // weight of a block in the mean square
+};
+
+#endif // LEVELMETER_H
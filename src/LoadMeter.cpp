@@ -0,0 +1,101 @@
+#include "LoadMeter.h"
+#include <iomanip>
+
+// Weight of the newest callback in the smoothed load
+static const float kLoadSmoothing = 0.05f;
+
+LoadMeter::LoadMeter()
+    : callbacks(0), xruns(0), lateCallbacks(0), lockMisses(0), loadPercent(0.0f), lastNs(0),
+      worstNs(0), deadlineNs(0), resetRequested(false)
+{
+    for (auto &bucket : histogram) {
+        bucket.store(0);
+    }
+}
+
+void LoadMeter::record(uint64_t elapsedNs, uint64_t deadline)
+{
+    if (resetRequested.exchange(false, std::memory_order_acq_rel)) {
+        callbacks.store(0, std::memory_order_relaxed);
+        xruns.store(0, std::memory_order_relaxed);
+        lateCallbacks.store(0, std::memory_order_relaxed);
+        lockMisses.store(0, std::memory_order_relaxed);
+        worstNs.store(0, std::memory_order_relaxed);
+        for (auto &bucket : histogram) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    if (deadline == 0) return;
+
+    float load = 100.0f * static_cast<float>(elapsedNs) / static_cast<float>(deadline);
+    float smoothed = loadPercent.load(std::memory_order_relaxed);
+    loadPercent.store(smoothed + (load - smoothed) * kLoadSmoothing, std::memory_order_relaxed);
+
+    int bucket = static_cast<int>(load) / kBucketPercent;
+    if (bucket >= kBuckets) bucket = kBuckets - 1;
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    if (elapsedNs > deadline) {
+        lateCallbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (elapsedNs > worstNs.load(std::memory_order_relaxed)) {
+        worstNs.store(elapsedNs, std::memory_order_relaxed);
+    }
+    lastNs.store(elapsedNs, std::memory_order_relaxed);
+    deadlineNs.store(deadline, std::memory_order_relaxed);
+    callbacks.fetch_add(1, std::memory_order_release);
+}
+
+void LoadMeter::recordXrun()
+{
+    xruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadMeter::recordLockMiss()
+{
+    lockMisses.fetch_add(1, std::memory_order_relaxed);
+}
+
+LoadMeter::Snapshot LoadMeter::snapshot() const
+{
+    Snapshot s;
+    s.callbacks = callbacks.load(std::memory_order_acquire);
+    s.xruns = xruns.load(std::memory_order_relaxed);
+    s.lateCallbacks = lateCallbacks.load(std::memory_order_relaxed);
+    s.lockMisses = lockMisses.load(std::memory_order_relaxed);
+    s.loadPercent = loadPercent.load(std::memory_order_relaxed);
+    s.lastNs = static_cast<double>(lastNs.load(std::memory_order_relaxed));
+    s.worstNs = static_cast<double>(worstNs.load(std::memory_order_relaxed));
+    s.deadlineNs = static_cast<double>(deadlineNs.load(std::memory_order_relaxed));
+    for (int i = 0; i < kBuckets; ++i) {
+        s.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+void LoadMeter::reset()
+{
+    resetRequested.store(true, std::memory_order_release);
+}
+
+void LoadMeter::writeJson(std::ostream& out) const
+{
+    Snapshot s = snapshot();
+    out << std::fixed << std::setprecision(3)
+        << "{\n"
+        << "  \"callbacks\": " << s.callbacks << ",\n"
+        << "  \"xruns\": " << s.xruns << ",\n"
+        << "  \"late_callbacks\": " << s.lateCallbacks << ",\n"
+        << "  \"lock_misses\": " << s.lockMisses << ",\n"
+        << "  \"load_percent\": " << s.loadPercent << ",\n"
+        << "  \"last_ms\": " << s.lastNs / 1e6 << ",\n"
+        << "  \"worst_ms\": " << s.worstNs / 1e6 << ",\n"
+        << "  \"deadline_ms\": " << s.deadlineNs / 1e6 << ",\n"
+        << "  \"histogram_bucket_percent\": " << kBucketPercent << ",\n"
+        << "  \"histogram\": [";
+    for (int i = 0; i < kBuckets; ++i) {
+        out << (i ? ", " : "") << s.histogram[i];
+    }
+    out << "]\n}\n";
+}
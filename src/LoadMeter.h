@@ -0,0 +1,63 @@
+#ifndef LOADMETER_H
+#define LOADMETER_H
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// Callback timing statistics. The audio thread is the only writer and only
+// touches atomics, so recording never blocks; readers get a slightly torn
+// but always valid view.
+class LoadMeter {
+public:
+    // Histogram of callback time as a share of its deadline, 10% per
+    // bucket; the last bucket collects everything above 190%
+    static const int kBuckets = 20;
+    static const int kBucketPercent = 10;
+
+    struct Snapshot {
+        uint64_t callbacks;
+        uint64_t xruns;          // underflows/overflows reported by the device
+        uint64_t lateCallbacks;  // callbacks that took longer than their deadline
+        uint64_t lockMisses;     // blocks output as silence while the engine was being edited
+        double loadPercent;      // smoothed DSP load
+        double lastNs;
+        double worstNs;
+        double deadlineNs;
+        uint64_t histogram[kBuckets];
+    };
+
+    LoadMeter();
+
+    // Audio thread: account one callback that took `elapsedNs` out of
+    // `deadlineNs` (the duration of the block it rendered)
+    void record(uint64_t elapsedNs, uint64_t deadlineNs);
+    // Audio thread: the device reported an underflow or overflow
+    void recordXrun();
+    // Audio thread: a block was skipped because instrumentsMutex was busy
+    void recordLockMiss();
+
+    Snapshot snapshot() const;
+    void reset();
+
+    // Write the statistics as a JSON object
+    void writeJson(std::ostream& out) const;
+
+private:
+    std::atomic<uint64_t> callbacks;
+    std::atomic<uint64_t> xruns;
+    std::atomic<uint64_t> lateCallbacks;
+    std::atomic<uint64_t> lockMisses;
+    std::atomic<float> loadPercent;
+    std::atomic<uint64_t> lastNs;
+    std::atomic<uint64_t> worstNs;
+    std::atomic<uint64_t> deadlineNs;
+    std::atomic<uint64_t> histogram[kBuckets];
+    // Set by reset() and honoured by the audio thread on its next record(),
+    // so the writer stays single-threaded
+    std::atomic<bool> resetRequested;
+};
+
+#endif // LOADMETER_H
@@ -0,0 +1,212 @@
+#include "MidiFile.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// A note or tempo event at an absolute tick position
+struct RawEvent {
+    uint64_t tick;
+    enum Type { NoteOn, NoteOff, Tempo } type;
+    int channel;
+    int note;
+    uint32_t tempo; // microseconds per quarter note
+};
+
+// Bounds-checked big-endian reader over the file contents
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& data, size_t pos, size_t end)
+        : data(data), pos(pos), end(end) {}
+
+    bool atEnd() const { return pos >= end; }
+    size_t position() const { return pos; }
+
+    uint8_t byte()
+    {
+        if (pos >= end) throw std::runtime_error("MIDI: unexpected end of data");
+        return data[pos++];
+    }
+
+    uint32_t fixed(int bytes)
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < bytes; ++i) v = (v << 8) | byte();
+        return v;
+    }
+
+    // Variable-length quantity, at most four bytes
+    uint32_t variable()
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            uint8_t b = byte();
+            v = (v << 7) | (b & 0x7f);
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("MIDI: malformed variable-length value");
+    }
+
+    void skip(size_t n)
+    {
+        if (n > end - pos) throw std::runtime_error("MIDI: unexpected end of data");
+        pos += n;
+    }
+
+private:
+    const std::vector<uint8_t>& data;
+    size_t pos;
+    size_t end;
+};
+
+void readTrack(Reader& in, std::vector<RawEvent>& events)
+{
+    uint64_t tick = 0;
+    uint8_t status = 0;
+
+    while (!in.atEnd()) {
+        tick += in.variable();
+
+        uint8_t b = in.byte();
+        uint8_t data1 = 0;
+        if (b & 0x80) {
+            status = b;
+            if (status < 0xf0) data1 = in.byte();
+        } else {
+            // Running status: this byte is the first data byte
+            if (status == 0 || status >= 0xf0) throw std::runtime_error("MIDI: bad running status");
+            data1 = b;
+        }
+
+        if (status == 0xff) {
+            uint8_t type = in.byte();
+            uint32_t length = in.variable();
+            if (type == 0x51 && length == 3) {
+                RawEvent e = { tick, RawEvent::Tempo, 0, 0, in.fixed(3) };
+                events.push_back(e);
+            } else if (type == 0x2f) {
+                in.skip(length);
+                return; // end of track
+            } else {
+                in.skip(length);
+            }
+            status = 0; // meta events cancel running status
+            continue;
+        }
+        if (status == 0xf0 || status == 0xf7) {
+            in.skip(in.variable());
+            status = 0;
+            continue;
+        }
+
+        int channel = status & 0x0f;
+        switch (status & 0xf0) {
+            case 0x80: {
+                in.byte(); // release velocity
+                RawEvent e = { tick, RawEvent::NoteOff, channel, data1 & 0x7f, 0 };
+                events.push_back(e);
+                break;
+            }
+            case 0x90: {
+                uint8_t velocity = in.byte();
+                RawEvent e = { tick, velocity ? RawEvent::NoteOn : RawEvent::NoteOff,
+                               channel, data1 & 0x7f, 0 };
+                events.push_back(e);
+                break;
+            }
+            case 0xa0: case 0xb0: case 0xe0:
+                in.byte(); // two data bytes, ignored
+                break;
+            case 0xc0: case 0xd0:
+                break;     // one data byte, already read
+            default:
+                throw std::runtime_error("MIDI: unsupported status byte");
+        }
+    }
+}
+
+} // namespace
+
+std::vector<NoteEvent> loadMidiFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open MIDI file: " + filename);
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Reader header(data, 0, data.size());
+    if (header.fixed(4) != 0x4d546864 /* MThd */ || header.fixed(4) < 6) {
+        throw std::runtime_error("Not a MIDI file: " + filename);
+    }
+    uint32_t format = header.fixed(2);
+    uint32_t trackCount = header.fixed(2);
+    uint32_t division = header.fixed(2);
+    if (format > 1) {
+        throw std::runtime_error("MIDI format " + std::to_string(format) + " is not supported");
+    }
+
+    std::vector<RawEvent> raw;
+    size_t pos = 8 + 6;
+    for (uint32_t t = 0; t < trackCount && pos + 8 <= data.size(); ++t) {
+        Reader chunk(data, pos, data.size());
+        uint32_t id = chunk.fixed(4);
+        uint32_t length = chunk.fixed(4);
+        size_t start = chunk.position();
+        if (length > data.size() - start) {
+            throw std::runtime_error("MIDI: truncated track in " + filename);
+        }
+        if (id == 0x4d54726b /* MTrk */) {
+            Reader track(data, start, start + length);
+            readTrack(track, raw);
+        }
+        pos = start + length;
+    }
+
+    // Merge tracks; stable so events at the same tick keep file order
+    std::stable_sort(raw.begin(), raw.end(), [](const RawEvent& a, const RawEvent& b) {
+        return a.tick < b.tick;
+    });
+
+    // Convert ticks to seconds through the tempo map
+    double secondsPerTick;
+    bool smpte = (division & 0x8000) != 0;
+    if (smpte) {
+        int framesPerSecond = -static_cast<int8_t>(division >> 8);
+        int ticksPerFrame = division & 0xff;
+        if (framesPerSecond <= 0 || ticksPerFrame == 0) throw std::runtime_error("MIDI: bad time division");
+        secondsPerTick = 1.0 / (framesPerSecond * ticksPerFrame);
+    } else {
+        if (division == 0) throw std::runtime_error("MIDI: bad time division");
+        secondsPerTick = 0.5 / division; // 120 BPM until the first tempo event
+    }
+
+    std::vector<NoteEvent> events;
+    int channelToInstrument[16];
+    std::fill(channelToInstrument, channelToInstrument + 16, -1);
+    int instrumentCount = 0;
+    uint64_t lastTick = 0;
+    double seconds = 0.0;
+
+    for (const RawEvent& e : raw) {
+        seconds += (e.tick - lastTick) * secondsPerTick;
+        lastTick = e.tick;
+
+        if (e.type == RawEvent::Tempo) {
+            if (!smpte && e.tempo > 0) secondsPerTick = e.tempo / 1e6 / division;
+            continue;
+        }
+        int& instrument = channelToInstrument[e.channel];
+        if (instrument < 0) {
+            if (e.type == RawEvent::NoteOff) continue;
+            instrument = instrumentCount++;
+        }
+        events.emplace_back(seconds, instrument, e.note, e.type == RawEvent::NoteOn);
+    }
+
+    sortNoteEvents(events);
+    return events;
+}
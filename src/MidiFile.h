@@ -0,0 +1,16 @@
+#ifndef MIDIFILE_H
+#define MIDIFILE_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "NoteSequence.h"
+
+// Read note on/off events from a Standard MIDI File (format 0 or 1).
+// Tempo changes are honoured and each MIDI channel that plays notes is
+// mapped to its own instrument, numbered in order of first use.
+// Throws std::runtime_error if the file cannot be read or parsed.
+std::vector<NoteEvent> loadMidiFile(const std::string& filename);
+
+#endif // MIDIFILE_H
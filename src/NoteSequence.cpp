@@ -0,0 +1,51 @@
+#include "NoteSequence.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+std::vector<NoteEvent> loadNoteList(const std::string& filename)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open note list: " + filename);
+    }
+
+    std::vector<NoteEvent> events;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        std::istringstream fields(line);
+        double start = 0.0, duration = 0.0;
+        int note = 0, instrument = 0;
+        if (!(fields >> start >> duration >> note) || start < 0.0 || duration <= 0.0 ||
+            note < 0 || note > 127) {
+            throw std::runtime_error(filename + ":" + std::to_string(lineNumber) +
+                                     ": expected <start> <duration> <note> [instrument]");
+        }
+        if (!(fields >> instrument)) {
+            instrument = 0;
+        } else if (instrument < 0) {
+            throw std::runtime_error(filename + ":" + std::to_string(lineNumber) +
+                                     ": instrument must not be negative");
+        }
+
+        events.emplace_back(start, instrument, note, true);
+        events.emplace_back(start + duration, instrument, note, false);
+    }
+
+    sortNoteEvents(events);
+    return events;
+}
+
+void sortNoteEvents(std::vector<NoteEvent>& events)
+{
+    std::stable_sort(events.begin(), events.end(), [](const NoteEvent& a, const NoteEvent& b) {
+        if (a.time != b.time) return a.time < b.time;
+        return !a.on && b.on;
+    });
+}
@@ -0,0 +1,29 @@
+#ifndef NOTESEQUENCE_H
+#define NOTESEQUENCE_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A timed note on/off for one instrument
+struct NoteEvent {
+    double time;    // seconds from the start of the sequence
+    int instrument; // index into the engine's instruments
+    int note;       // MIDI note number
+    bool on;
+
+    NoteEvent(double time, int instrument, int note, bool on)
+        : time(time), instrument(instrument), note(note), on(on) {}
+};
+
+// Load a plain-text note list. Each non-empty line that does not start
+// with '#' reads
+//     <start seconds> <duration seconds> <midi note> [instrument]
+// Throws std::runtime_error on unreadable files or malformed lines.
+std::vector<NoteEvent> loadNoteList(const std::string& filename);
+
+// Sort events by time, with note-offs before note-ons at the same instant
+void sortNoteEvents(std::vector<NoteEvent>& events);
+
+#endif // NOTESEQUENCE_H
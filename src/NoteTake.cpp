@@ -0,0 +1,247 @@
+#include "NoteTake.h"
+#include <algorithm>
+
+const size_t NoteTake::kCheckpointEvents;
+
+NoteTake::NoteTake(const std::string& waveform)
+    : length(0.0), waveform(waveform), tempo(1.0), sampleRate(48000.0), recordRate(48000.0),
+      recording(false), recordedFrames(0), voicesRequested(0), voicesInstalled(0), cursor(0),
+      position(static_cast<size_t>(-1)) {}
+
+void NoteTake::start(double rate)
+{
+    recordRate = rate;
+    recording = true;
+    recordedFrames.store(0);
+}
+
+void NoteTake::record(int note, bool on)
+{
+    Event e;
+    e.time = recordedFrames.load(std::memory_order_relaxed) / recordRate;
+    e.note = note;
+    e.on = on;
+    events.push_back(e);
+}
+
+void NoteTake::finish(double rate)
+{
+    recording = false;
+    length = recordedFrames.load() / recordRate;
+
+    // Close notes still held when recording stopped
+    std::vector<int> held;
+    for (const Event& e : events) {
+        if (e.on) {
+            held.push_back(e.note);
+        } else {
+            auto it = std::find(held.begin(), held.end(), e.note);
+            if (it != held.end()) held.erase(it);
+        }
+    }
+    for (int note : held) {
+        Event e;
+        e.time = length;
+        e.note = note;
+        e.on = false;
+        events.push_back(e);
+    }
+    // Offs before ons at the same time, like the note sequence
+    std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        if (a.time != b.time) return a.time < b.time;
+        return !a.on && b.on;
+    });
+    // Rebuilt for the new event order when the voices are installed
+    checkpointNotes.clear();
+    checkpointStarts.clear();
+    prepare(rate);
+}
+
+void NoteTake::setWaveform(const std::string& w)
+{
+    waveform = w;
+    prepare(sampleRate);
+}
+
+void NoteTake::setTempo(double t)
+{
+    tempo = std::max(0.1, t);
+    position = static_cast<size_t>(-1);
+}
+
+void NoteTake::prepare(double rate)
+{
+    sampleRate = rate;
+    // Keep the current voices in tune until the new ones are installed
+    for (auto &p : prototypes) {
+        p.second.osc.setSampleRate(rate);
+    }
+    for (auto &v : pool) {
+        v.osc.setSampleRate(rate);
+    }
+    ++voicesRequested;
+    position = static_cast<size_t>(-1);
+}
+
+NoteTake::VoiceBuild NoteTake::voiceRequest() const
+{
+    VoiceBuild b;
+    b.request = voicesRequested;
+    b.waveform = waveform;
+    b.sampleRate = sampleRate;
+    b.polyphony = 0;
+    size_t sounding = 0;
+    for (const Event& e : events) {
+        if (e.on) {
+            ++sounding;
+            b.polyphony = std::max(b.polyphony, sounding);
+            if (std::find(b.notes.begin(), b.notes.end(), e.note) == b.notes.end()) {
+                b.notes.push_back(e.note);
+            }
+        } else if (sounding > 0) {
+            --sounding;
+        }
+    }
+    return b;
+}
+
+void NoteTake::VoiceBuild::build()
+{
+    prototypes.clear();
+    for (int note : notes) {
+        Voice v(kVoiceTableSize, sampleRate);
+        v.note = note;
+        v.osc.setWaveform(waveform);
+        v.osc.setNote(note);
+        prototypes.insert(std::make_pair(note, std::move(v)));
+    }
+    pool.clear();
+    if (!prototypes.empty()) {
+        pool.assign(polyphony, prototypes.begin()->second);
+    }
+}
+
+void NoteTake::installVoices(VoiceBuild& built)
+{
+    if (built.request != voicesRequested) return;
+    prototypes.swap(built.prototypes);
+    pool.swap(built.pool);
+    poolNotes.assign(pool.size(), -1);
+    poolStarts.assign(pool.size(), 0);
+    buildCheckpoints();
+    voicesInstalled = built.request;
+    position = static_cast<size_t>(-1);
+}
+
+size_t NoteTake::frames() const
+{
+    if (recording) return recordedFrames.load(std::memory_order_relaxed);
+    return static_cast<size_t>(length * sampleRate / tempo);
+}
+
+size_t NoteTake::eventFrame(size_t index) const
+{
+    return static_cast<size_t>(events[index].time * sampleRate / tempo);
+}
+
+void NoteTake::buildCheckpoints()
+{
+    checkpointNotes.clear();
+    checkpointStarts.clear();
+    if (pool.empty()) return;
+    std::fill(poolNotes.begin(), poolNotes.end(), -1);
+    std::vector<size_t> startEvents(pool.size(), 0);
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (i % kCheckpointEvents == 0) {
+            checkpointNotes.insert(checkpointNotes.end(), poolNotes.begin(), poolNotes.end());
+            checkpointStarts.insert(checkpointStarts.end(), startEvents.begin(), startEvents.end());
+        }
+        int slot = claim(events[i]);
+        if (slot >= 0) startEvents[slot] = i;
+    }
+    std::fill(poolNotes.begin(), poolNotes.end(), -1);
+}
+
+void NoteTake::seek(size_t frame)
+{
+    std::fill(poolNotes.begin(), poolNotes.end(), -1);
+    size_t lo = 0, hi = events.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (eventFrame(mid) < frame) lo = mid + 1; else hi = mid;
+    }
+    cursor = lo;
+
+    // Notes held across `frame`: restore the slots from the last
+    // checkpoint before it and replay the events after that on the slots
+    // alone, then start each held voice at the phase it would have reached
+    size_t first = 0;
+    size_t saved = pool.empty() ? 0 : checkpointNotes.size() / pool.size();
+    if (saved > 0) {
+        size_t c = std::min(cursor / kCheckpointEvents, saved - 1);
+        for (size_t v = 0; v < pool.size(); ++v) {
+            poolNotes[v] = checkpointNotes[c * pool.size() + v];
+            poolStarts[v] = eventFrame(checkpointStarts[c * pool.size() + v]);
+        }
+        first = c * kCheckpointEvents;
+    }
+    for (size_t i = first; i < cursor; ++i) {
+        int slot = claim(events[i]);
+        if (slot >= 0) poolStarts[slot] = eventFrame(i);
+    }
+    for (size_t v = 0; v < pool.size(); ++v) {
+        if (poolNotes[v] < 0) continue;
+        pool[v] = prototypes.find(poolNotes[v])->second;
+        pool[v].osc.skip(frame - poolStarts[v]);
+    }
+}
+
+int NoteTake::claim(const Event& e)
+{
+    if (e.on) {
+        if (pool.empty() || !prototypes.count(e.note)) return -1;
+        size_t slot = std::find(poolNotes.begin(), poolNotes.end(), -1) - poolNotes.begin();
+        if (slot == poolNotes.size()) slot = 0;
+        poolNotes[slot] = e.note;
+        return static_cast<int>(slot);
+    }
+    for (size_t i = 0; i < poolNotes.size(); ++i) {
+        if (poolNotes[i] == e.note) {
+            poolNotes[i] = -1;
+            break;
+        }
+    }
+    return -1;
+}
+
+void NoteTake::apply(size_t index)
+{
+    int slot = claim(events[index]);
+    if (slot < 0) return;
+    // Same-sized tables, so the copy reuses the slot's storage
+    pool[slot] = prototypes.find(events[index].note)->second;
+    poolStarts[slot] = eventFrame(index);
+}
+
+void NoteTake::render(size_t from, float* out, size_t frames, float gain)
+{
+    if (from != position) seek(from);
+
+    size_t pos = from;
+    size_t end = from + frames;
+    while (pos < end) {
+        while (cursor < events.size() && eventFrame(cursor) <= pos) {
+            apply(cursor++);
+        }
+        size_t next = cursor < events.size() ? std::min(end, eventFrame(cursor)) : end;
+        for (size_t i = pos; i < next; ++i) {
+            float value = 0.0f;
+            for (size_t v = 0; v < pool.size(); ++v) {
+                if (poolNotes[v] >= 0) value += static_cast<float>(pool[v].osc.getWaveformValue());
+            }
+            out[i - from] += value * gain;
+        }
+        pos = next;
+    }
+    position = end;
+}
@@ -0,0 +1,120 @@
+#ifndef NOTETAKE_H
+#define NOTETAKE_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Voice.h"
+
+// A take recorded as note events instead of audio. Playback regenerates
+// the sound through voices of its own, so the waveform and tempo can be
+// changed afterwards and a take costs a few bytes per note instead of
+// 192 KB per second.
+class NoteTake {
+public:
+    struct Event {
+        double time; // seconds from the start of the take, at tempo 1
+        int note;    // MIDI note number
+        bool on;
+    };
+
+    explicit NoteTake(const std::string& waveform);
+
+    NoteTake(const NoteTake&) = delete;
+    NoteTake& operator=(const NoteTake&) = delete;
+
+    // Recording, with instrumentsMutex held. The audio thread advances the
+    // take's clock by each block it renders while recording, and notes are
+    // stamped with that clock.
+    void start(double sampleRate);
+    void advance(size_t frames) { recordedFrames.fetch_add(frames, std::memory_order_relaxed); }
+    void record(int note, bool on);
+    // Release held notes, fix the length and request the voices
+    void finish(double sampleRate);
+
+    // Control thread, with instrumentsMutex held: change how the take
+    // sounds. Waveform and sample rate changes request new voices.
+    void setWaveform(const std::string& waveform);
+    void setTempo(double tempo);
+    void prepare(double sampleRate);
+
+    // Voices for the take at one waveform and sample rate. Building them
+    // takes a while (band-limited tables per note), so it is split in
+    // three: voiceRequest() with instrumentsMutex held, build() without
+    // it, and installVoices() with it again.
+    struct VoiceBuild {
+        uint64_t request;
+        std::string waveform;
+        double sampleRate;
+        std::vector<int> notes; // distinct notes of the take
+        size_t polyphony;
+        std::map<int, Voice> prototypes;
+        std::vector<Voice> pool;
+
+        void build();
+    };
+    // True while the installed voices are out of date
+    bool voicesPending() const { return voicesRequested != voicesInstalled; }
+    VoiceBuild voiceRequest() const;
+    // Swap in built voices unless another change was requested meanwhile.
+    // The old voices are left in `built`, to be freed after unlocking.
+    void installVoices(VoiceBuild& built);
+
+    const std::string& getWaveform() const { return waveform; }
+    double getTempo() const { return tempo; }
+    const std::vector<Event>& getEvents() const { return events; }
+    // Length at the current tempo, in frames at the prepared sample rate;
+    // while recording, the frames recorded so far
+    size_t frames() const;
+    bool empty() const { return events.empty(); }
+
+    // Audio thread: add `frames` samples starting `from` frames into the
+    // take to `out`. Jumps in `from` restart the voices at that point.
+    void render(size_t from, float* out, size_t frames, float gain);
+
+private:
+    size_t eventFrame(size_t index) const;
+    // Record the pool slots every kCheckpointEvents events, for seek()
+    void buildCheckpoints();
+    // Restart playback at `frame`, with the notes held across it sounding
+    void seek(size_t frame);
+    // Update the pool slots for `e`; returns the slot a note-on took, or -1
+    int claim(const Event& e);
+    // Start or stop the voice for event `index`
+    void apply(size_t index);
+
+    std::vector<Event> events;  // sorted by time once finished
+    double length;              // seconds at tempo 1
+    std::string waveform;
+    double tempo;               // playback speed, 1 = as recorded
+    double sampleRate;
+    double recordRate;
+    bool recording;
+    std::atomic<size_t> recordedFrames;
+
+    // Ready-made voices per note and a fixed pool to play them in, sized
+    // for the take's polyphony so playback never allocates
+    std::map<int, Voice> prototypes;
+    std::vector<Voice> pool;
+    std::vector<int> poolNotes;     // note per pool slot, -1 when free
+    std::vector<size_t> poolStarts; // frame each slot's note started at
+    // Pool slot notes and the events that started them, pool.size() of
+    // each per checkpoint, taken before every kCheckpointEvents-th event.
+    // They depend on the event order and the pool, not the tempo or rate,
+    // and let a seek replay at most kCheckpointEvents events.
+    static const size_t kCheckpointEvents = 64;
+    std::vector<int> checkpointNotes;
+    std::vector<size_t> checkpointStarts;
+    uint64_t voicesRequested;
+    uint64_t voicesInstalled;
+    size_t cursor;              // next event to apply
+    size_t position;            // frame the next render is expected at
+};
+
+#endif // NOTETAKE_H
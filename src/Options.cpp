@@ -0,0 +1,193 @@
+#include "Options.h"
+#include "Realtime.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+// Buffer size used by --low-latency unless --buffer-size is given
+static const unsigned long kLowLatencyFrames = 128;
+
+// Parse a positive integer, rejecting trailing garbage
+static bool parseNumber(const char* text, long& value)
+{
+    char* end = nullptr;
+    value = std::strtol(text, &end, 10);
+    return end != text && *end == '\0' && value > 0;
+}
+
+bool parseOptions(int argc, char** argv, Options& options, std::string& error, bool headless)
+{
+    bool bufferSizeGiven = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        long value = 0;
+
+        if (arg == "-h" || arg == "--help") {
+            options.showHelp = true;
+        } else if (arg == "--sample-rate") {
+            if (!hasValue || !parseNumber(argv[++i], value)) {
+                error = "--sample-rate expects a rate in Hz";
+                return false;
+            }
+            options.audio.sampleRate = static_cast<double>(value);
+        } else if (arg == "--buffer-size") {
+            if (!hasValue || !parseNumber(argv[++i], value)) {
+                error = "--buffer-size expects a frame count";
+                return false;
+            }
+            options.audio.framesPerBuffer = static_cast<unsigned long>(value);
+            bufferSizeGiven = true;
+        } else if (arg == "--low-latency") {
+            options.audio.lowLatency = true;
+        } else if (arg == "--workers") {
+            char* end = nullptr;
+            if (!hasValue) {
+                error = "--workers expects a thread count";
+                return false;
+            }
+            long n = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 0) {
+                error = "--workers expects a thread count";
+                return false;
+            }
+            options.audio.workerThreads = static_cast<int>(n);
+        } else if (arg == "--backend") {
+            if (!hasValue) {
+                error = "--backend expects portaudio, null or file";
+                return false;
+            }
+            std::string name = argv[++i];
+            if (name != "portaudio" && name != "null" && name != "file") {
+                error = "unknown backend " + name + " (expected portaudio, null or file)";
+                return false;
+            }
+            options.audio.backend = name;
+        } else if (arg == "--output") {
+            if (!hasValue) {
+                error = "--output expects a path";
+                return false;
+            }
+            options.audio.outputFile = argv[++i];
+        } else if (arg == "--record-dir") {
+            if (!hasValue) {
+                error = "--record-dir expects a directory";
+                return false;
+            }
+            options.audio.recordDirectory = argv[++i];
+        } else if (arg == "--rt-priority") {
+            char* end = nullptr;
+            long priority = hasValue ? std::strtol(argv[++i], &end, 10) : -1;
+            if (!end || *end != '\0' || priority < 0 || priority > 99) {
+                error = "--rt-priority expects 0-99";
+                return false;
+            }
+            options.audio.realtimePriority = static_cast<int>(priority);
+        } else if (arg == "--no-flush-denormals") {
+            options.audio.flushDenormals = false;
+        } else if (arg == "--dc-injection") {
+            options.audio.dcInjection = true;
+        } else if (headless && arg == "--bench-denormals") {
+            options.benchDenormals = true;
+        } else if (arg == "--mlock") {
+            options.audio.lockMemory = true;
+        } else if (arg == "--audio-cpus" || arg == "--worker-cpus") {
+            std::vector<int>& cpus = arg == "--audio-cpus" ? options.audio.audioCpus
+                                                           : options.audio.workerCpus;
+            if (!hasValue || !parseCpuList(argv[++i], cpus)) {
+                error = arg + " expects a comma separated core list";
+                return false;
+            }
+        } else if (arg == "--stats-file") {
+            if (!hasValue) {
+                error = "--stats-file expects a path";
+                return false;
+            }
+            options.statsFile = argv[++i];
+        } else if (arg == "--track") {
+            if (!hasValue) {
+                error = "--track expects a WAV file";
+                return false;
+            }
+            options.trackFiles.push_back(argv[++i]);
+        } else if (headless && (arg == "--notes" || arg == "--midi" || arg == "--render" ||
+                                arg == "--waveform")) {
+            if (!hasValue) {
+                error = arg + " expects a value";
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--notes") options.notesFile = value;
+            else if (arg == "--midi") options.midiFile = value;
+            else if (arg == "--render") options.renderFile = value;
+            else options.waveform = value;
+        } else if (headless && arg == "--tail") {
+            char* end = nullptr;
+            double seconds = hasValue ? std::strtod(argv[++i], &end) : -1.0;
+            if (!end || *end != '\0' || seconds < 0.0) {
+                error = "--tail expects a duration in seconds";
+                return false;
+            }
+            options.tailSeconds = seconds;
+        } else if (!headless && arg == "--fps") {
+            if (!hasValue || !parseNumber(argv[++i], value)) {
+                error = "--fps expects a frame rate";
+                return false;
+            }
+            options.fpsCap = static_cast<unsigned>(value);
+        } else {
+            error = "unknown option " + arg;
+            return false;
+        }
+    }
+
+    if (options.audio.backend == "file" && options.audio.outputFile.empty()) {
+        error = "--backend file needs --output";
+        return false;
+    }
+    // A worker sharing a core with the audio thread can stall it: the audio
+    // thread waits for the worker's share of the graph at a higher priority
+    for (int cpu : options.audio.workerCpus) {
+        if (std::find(options.audio.audioCpus.begin(), options.audio.audioCpus.end(), cpu) !=
+            options.audio.audioCpus.end()) {
+            error = "--audio-cpus and --worker-cpus overlap on core " + std::to_string(cpu);
+            return false;
+        }
+    }
+    if (options.audio.lowLatency && !bufferSizeGiven) {
+        options.audio.framesPerBuffer = kLowLatencyFrames;
+    }
+    return true;
+}
+
+void printUsage(const char* program, bool headless)
+{
+    std::cout << "Usage: " << program << " [options]\n";
+    if (headless) {
+        std::cout << "  --notes FILE        play a note list (<start> <duration> <note> [instrument] per line)\n"
+                  << "  --midi FILE         play a Standard MIDI File\n"
+                  << "  --render FILE       render offline to a WAV file instead of playing\n"
+                  << "  --waveform NAME     sine, square, sawtooth, triangle or noise (default sine)\n"
+                  << "  --tail SECONDS      keep going after the last note (default 2)\n"
+                  << "  --bench-denormals   time long feedback tails with and without denormal protection\n";
+    } else {
+        std::cout << "  --fps N             frame rate limit while playing or editing (default 60)\n";
+    }
+    std::cout << "  --sample-rate HZ    output sample rate (default 48000)\n"
+              << "  --buffer-size N     frames per buffer (default 1024)\n"
+              << "  --low-latency       use the device's low latency and 128-frame buffers\n"
+              << "  --workers N         graph worker threads (default: from core count)\n"
+              << "  --backend NAME      portaudio (default), null or file\n"
+              << "  --output PATH       file backend destination (.wav, otherwise raw float32)\n"
+              << "  --record-dir DIR    stream recorded takes to WAV files in DIR\n"
+              << "  --rt-priority N     SCHED_FIFO priority for the audio thread (default 70, 0 = off)\n"
+              << "  --no-flush-denormals  leave FTZ/DAZ off on the audio threads\n"
+              << "  --dc-injection      keep feedback structures out of subnormal range with a tiny offset\n"
+              << "  --mlock             lock the process memory into RAM\n"
+              << "  --audio-cpus LIST   pin the audio thread to cores, e.g. 2,3\n"
+              << "  --worker-cpus LIST  pin graph workers to cores, one core each in turn (not the audio cores)\n"
+              << "  --track FILE        add a track playing a mono float WAV file from disk (repeatable)\n"
+              << "  --stats-file PATH   write callback load statistics as JSON on exit\n"
+              << "  -h, --help          show this help\n";
+}
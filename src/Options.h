@@ -0,0 +1,40 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "AudioEngine.h"
+
+// Command-line options shared by the synth front ends
+struct Options {
+    AudioSettings audio;
+    std::string statsFile; // write load statistics as JSON here on exit
+    std::vector<std::string> trackFiles; // WAV files to add as tracks
+    bool showHelp;
+
+    // Headless front end only
+    std::string notesFile;   // plain-text note list to play
+    std::string midiFile;    // Standard MIDI File to play
+    std::string renderFile;  // render offline to this WAV file instead of playing
+    std::string waveform;    // waveform for every instrument
+    double tailSeconds;      // time to keep rendering after the last note
+    bool benchDenormals;     // run the denormal benchmark and exit
+
+    // Window front end only
+    unsigned fpsCap;         // frame rate limit while playing or editing
+
+    Options() : showHelp(false), waveform("sine"), tailSeconds(2.0), benchDenormals(false), fpsCap(60) {}
+};
+
+// Parse argv into `options`. Returns false and sets `error` on bad input.
+// Options that only make sense without a window are rejected unless
+// `headless` is set, and window-only options when it is.
+bool parseOptions(int argc, char** argv, Options& options, std::string& error,
+                  bool headless = false);
+
+// Print the option summary
+void printUsage(const char* program, bool headless = false);
+
+#endif // OPTIONS_H
@@ -9,9 +9,13 @@
 // Define maximum number of harmonics for waveforms
 #define MAX_HARMONICS 500
 
+// Length of the crossfade when a sounding voice changes waveform
+static const double kWaveformFadeSeconds = 0.01;
+
 // Oscillator constructor
 Oscillator::Oscillator(unsigned tableSize, double sampleRate)
-    : sampleRate(sampleRate), frequency(0.0), currentPosition(0.0), volume(1.0)
+    : fadeWaveTable(nullptr), fadeLength(0), fadeRemaining(0),
+      sampleRate(sampleRate), frequency(0.0), currentPosition(0.0), volume(1.0)
 {
     // Resize wave tables based on input tableSize
     sineWaveTable.resize(tableSize);
@@ -42,6 +46,8 @@ Oscillator::Oscillator(const Oscillator& other)
       triangleWaveTable(other.triangleWaveTable),
       noiseWaveTable(other.noiseWaveTable),
       silentWaveTable(other.silentWaveTable),
+      fadeLength(other.fadeLength),
+      fadeRemaining(other.fadeRemaining),
       sampleRate(other.sampleRate),
       frequency(other.frequency),
       currentPosition(other.currentPosition),
@@ -61,6 +67,8 @@ Oscillator& Oscillator::operator=(const Oscillator& other)
         noiseWaveTable  = other.noiseWaveTable;
         silentWaveTable = other.silentWaveTable;
 
+        fadeLength = other.fadeLength;
+        fadeRemaining = other.fadeRemaining;
         sampleRate = other.sampleRate;
         frequency = other.frequency;
         currentPosition = other.currentPosition;
@@ -79,6 +87,8 @@ Oscillator::Oscillator(Oscillator&& other) noexcept
       triangleWaveTable(std::move(other.triangleWaveTable)),
       noiseWaveTable(std::move(other.noiseWaveTable)),
       silentWaveTable(std::move(other.silentWaveTable)),
+      fadeLength(other.fadeLength),
+      fadeRemaining(other.fadeRemaining),
       sampleRate(other.sampleRate),
       frequency(other.frequency),
       currentPosition(other.currentPosition),
@@ -98,6 +108,8 @@ Oscillator& Oscillator::operator=(Oscillator&& other) noexcept
         noiseWaveTable  = std::move(other.noiseWaveTable);
         silentWaveTable = std::move(other.silentWaveTable);
 
+        fadeLength = other.fadeLength;
+        fadeRemaining = other.fadeRemaining;
         sampleRate = other.sampleRate;
         frequency = other.frequency;
         currentPosition = other.currentPosition;
@@ -108,22 +120,22 @@ Oscillator& Oscillator::operator=(Oscillator&& other) noexcept
     return *this;
 }
 
+// Helper to map a table pointer of `other` to the same table of this one
+std::vector<double>* Oscillator::ownTable(const Oscillator& other, const std::vector<double>* table)
+{
+    if (table == &other.sineWaveTable) return &sineWaveTable;
+    if (table == &other.squareWaveTable) return &squareWaveTable;
+    if (table == &other.sawtoothWaveTable) return &sawtoothWaveTable;
+    if (table == &other.triangleWaveTable) return &triangleWaveTable;
+    if (table == &other.noiseWaveTable) return &noiseWaveTable;
+    return &silentWaveTable;
+}
+
 // Helper to map active table pointer after copy/move
 void Oscillator::copyActiveWaveTable(const Oscillator& other)
 {
-    if (other.activeWaveTable == &other.sineWaveTable) {
-        activeWaveTable = &sineWaveTable;
-    } else if (other.activeWaveTable == &other.squareWaveTable) {
-        activeWaveTable = &squareWaveTable;
-    } else if (other.activeWaveTable == &other.sawtoothWaveTable) {
-        activeWaveTable = &sawtoothWaveTable;
-    } else if (other.activeWaveTable == &other.triangleWaveTable) {
-        activeWaveTable = &triangleWaveTable;
-    } else if (other.activeWaveTable == &other.noiseWaveTable) {
-        activeWaveTable = &noiseWaveTable;
-    } else {
-        activeWaveTable = &silentWaveTable;
-    }
+    activeWaveTable = ownTable(other, other.activeWaveTable);
+    fadeWaveTable = other.fadeWaveTable ? ownTable(other, other.fadeWaveTable) : nullptr;
 }
 
 // Function to generate a sine waveform
@@ -163,7 +175,9 @@ void Oscillator::updateNoiseWaveTable() {
 }
 
 // Function to set the waveform type
-void Oscillator::setWaveform(const std::string& waveform) {
+void Oscillator::setWaveform(const std::string& waveform, bool crossfade) {
+    std::vector<double>* previous = activeWaveTable;
+
     // Switch the active waveform based on input string
     if (waveform == "sine") {
         activeWaveTable = &sineWaveTable;
@@ -187,6 +201,15 @@ void Oscillator::setWaveform(const std::string& waveform) {
         std::cout << "Invalid waveform. Defaulting to silent." << std::endl;
         activeWaveTable = &silentWaveTable;
     }
+
+    if (crossfade && activeWaveTable != previous) {
+        // A switch during a fade starts over from the table that was fading in
+        fadeWaveTable = previous;
+        fadeLength = std::max(1u, static_cast<unsigned>(kWaveformFadeSeconds * sampleRate));
+        fadeRemaining = fadeLength;
+    } else if (!crossfade) {
+        fadeRemaining = 0;
+    }
 }
 
 // Function to set the frequency and update all the wave tables
@@ -244,35 +267,54 @@ void Oscillator::setVolume(double volume) {
 	this->volume = volume;
 }
 
-// Function to generate the next value in the waveform
-double Oscillator::getWaveformValue() {
-    // Update position in the wave
-    double advance = frequency / sampleRate;
-    currentPosition = fmod(currentPosition + advance, 1.0);
+// Function to change the sample rate, rebuilding the band-limited tables
+void Oscillator::setSampleRate(double sampleRate) {
+    this->sampleRate = sampleRate;
+    setFrequency(frequency);
+}
 
-    // Interpolate to get a more accurate waveform value
-    double position = currentPosition * activeWaveTable->size();
+// Cubic-interpolated value of a table at the current position
+double Oscillator::tableValue(const std::vector<double>& table) const
+{
+    double position = currentPosition * table.size();
     unsigned index = (unsigned)position;
     double fraction = position - index;
 
-    unsigned nextIndex = (index + 1) % activeWaveTable->size();
-    unsigned nextNextIndex = (index + 2) % activeWaveTable->size();
-    unsigned prevIndex = (index - 1 + activeWaveTable->size()) % activeWaveTable->size();
+    unsigned nextIndex = (index + 1) % table.size();
+    unsigned nextNextIndex = (index + 2) % table.size();
+    unsigned prevIndex = (index - 1 + table.size()) % table.size();
 
     // Cubic interpolation
-    double value0 = (*activeWaveTable)[prevIndex];
-    double value1 = (*activeWaveTable)[index];
-    double value2 = (*activeWaveTable)[nextIndex];
-    double value3 = (*activeWaveTable)[nextNextIndex];
+    double value0 = table[prevIndex];
+    double value1 = table[index];
+    double value2 = table[nextIndex];
+    double value3 = table[nextNextIndex];
 
     double P = (value3 - value2) - (value0 - value1);
     double Q = (value0 - value1) - P;
     double R = value2 - value0;
     double S = value1;
 
-    double interpolatedValue = P*fraction*fraction*fraction + Q*fraction*fraction + R*fraction + S;
+    return P*fraction*fraction*fraction + Q*fraction*fraction + R*fraction + S;
+}
+
+// Function to generate the next value in the waveform
+double Oscillator::getWaveformValue() {
+    // Update position in the wave
+    double advance = frequency / sampleRate;
+    currentPosition = fmod(currentPosition + advance, 1.0);
+
+    double value = tableValue(*activeWaveTable);
+    if (fadeRemaining > 0) {
+        // Equal phase, so a linear blend of the two tables is click-free
+        double t = static_cast<double>(fadeRemaining--) / fadeLength;
+        value = value * (1.0 - t) + tableValue(*fadeWaveTable) * t;
+    }
+    return value * volume;
+}
 
-    return interpolatedValue * volume;
+void Oscillator::skip(size_t samples) {
+    currentPosition = fmod(currentPosition + samples * (frequency / sampleRate), 1.0);
 }
 
 // Function to normalize the amplitude of the waveform to 1
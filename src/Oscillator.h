@@ -1,6 +1,7 @@
 #ifndef OSCILLATOR_H
 #define OSCILLATOR_H
 
+#include <cstddef>
 #include <vector>
 #include <string>
 
@@ -17,12 +18,17 @@ public:
     Oscillator(Oscillator&& other) noexcept;
     Oscillator& operator=(Oscillator&& other) noexcept;
 
-    void setWaveform(const std::string& waveform);
+    // Switch tables. With `crossfade` the old waveform fades out over a few
+    // milliseconds at the same phase, for voices that are already sounding.
+    void setWaveform(const std::string& waveform, bool crossfade = false);
     void setFrequency(double frequency);
     void setNote(int note);
     void setVolume(double volume);
+    void setSampleRate(double sampleRate);
 
     double getWaveformValue();
+    // Move the phase on as if `samples` values had been generated
+    void skip(size_t samples);
 
 private:
     void updateSineWaveTable();
@@ -32,12 +38,16 @@ private:
     void updateNoiseWaveTable();
 
     double noteToFrequency(int note);
+    // Cubic-interpolated value of `table` at the current position
+    double tableValue(const std::vector<double>& table) const;
 
     void normalizeAmplitude(std::vector<double>& waveform);
     void applyWindow(std::vector<double>& waveform, const std::vector<double>& window);
 
-    // Helper used by copy/move operations to set the active table pointer
+    // Helper used by copy/move operations to set the active and fading
+    // table pointers
     void copyActiveWaveTable(const Oscillator& other);
+    std::vector<double>* ownTable(const Oscillator& other, const std::vector<double>* table);
 
     std::vector<double> sineWaveTable;
     std::vector<double> squareWaveTable;
@@ -47,6 +57,9 @@ private:
     std::vector<double> silentWaveTable;
 
     std::vector<double>* activeWaveTable;
+    std::vector<double>* fadeWaveTable; // previous table while crossfading
+    unsigned fadeLength;
+    unsigned fadeRemaining;
 
     double sampleRate;
     double frequency;
@@ -0,0 +1,133 @@
+#include "PeakCache.h"
+#include <algorithm>
+#include <cmath>
+
+const size_t PeakCache::kLevels;
+const size_t PeakCache::kBlockFrames;
+
+// Entries for one kBlockFrames stretch of the take, at every level
+struct PeakCache::Block {
+    PeakCache::Peak fine[kBlockFrames / 64];
+    PeakCache::Peak medium[kBlockFrames / 512];
+    PeakCache::Peak coarse[kBlockFrames / 4096];
+};
+
+PeakCache::PeakCache(size_t maxFrames)
+    : blocks((maxFrames + kBlockFrames - 1) / kBlockFrames), complete(0), entries(0),
+      accMin(0.0f), accMax(0.0f), accSquares(0.0), accFrames(0)
+{
+}
+
+PeakCache::~PeakCache()
+{
+    for (size_t i = 0; i < blocks.capacity(); ++i) {
+        delete blocks.load(i);
+    }
+}
+
+void PeakCache::clear()
+{
+    complete.store(0, std::memory_order_release);
+    entries = 0;
+    accFrames = 0;
+}
+
+PeakCache::Peak* PeakCache::entry(size_t level, size_t index) const
+{
+    size_t perBlock = kBlockFrames / levelFrames(level);
+    Block* block = blocks.load(index / perBlock);
+    if (!block) return nullptr;
+    Peak* entries = level == 0 ? block->fine : level == 1 ? block->medium : block->coarse;
+    return entries + index % perBlock;
+}
+
+void PeakCache::add(const float* samples, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        float s = samples[i];
+        if (accFrames == 0) {
+            accMin = accMax = s;
+            accSquares = 0.0;
+        }
+        accMin = std::min(accMin, s);
+        accMax = std::max(accMax, s);
+        accSquares += static_cast<double>(s) * s;
+        if (++accFrames < levelFrames(0)) continue;
+
+        Peak p;
+        p.min = accMin;
+        p.max = accMax;
+        p.rms = static_cast<float>(std::sqrt(accSquares / accFrames));
+        accFrames = 0;
+        addEntry(p);
+    }
+}
+
+void PeakCache::addEntry(const Peak& peak)
+{
+    size_t index = entries;
+    size_t blockIndex = index / (kBlockFrames / levelFrames(0));
+    if (blockIndex >= blocks.capacity()) return;
+    std::atomic<Block*>& slot = blocks.slot(blockIndex);
+    if (!slot.load(std::memory_order_relaxed)) {
+        slot.store(new Block(), std::memory_order_release);
+    }
+    *entry(0, index) = peak;
+    ++entries;
+    // Coarser entries finish with every 8th finer one
+    for (size_t level = 1; level < kLevels && (index + 1) % 8 == 0; ++level) {
+        index /= 8;
+        finishEntry(level, index);
+    }
+    complete.store(entries * levelFrames(0), std::memory_order_release);
+}
+
+void PeakCache::finishEntry(size_t level, size_t index)
+{
+    Peak* out = entry(level, index);
+    const Peak* in = entry(level - 1, index * 8);
+    Peak p = in[0];
+    float squares = 0.0f;
+    for (size_t i = 0; i < 8; ++i) {
+        p.min = std::min(p.min, in[i].min);
+        p.max = std::max(p.max, in[i].max);
+        squares += in[i].rms * in[i].rms;
+    }
+    p.rms = std::sqrt(squares / 8.0f);
+    *out = p;
+}
+
+bool PeakCache::range(size_t from, size_t to, Peak& out) const
+{
+    to = std::min(to, frames());
+    if (from >= to) return false;
+
+    size_t level = kLevels - 1;
+    while (level > 0 && levelFrames(level) > to - from) --level;
+    size_t step = levelFrames(level);
+    size_t first = from / step;
+    size_t last = (to + step - 1) / step;
+    // A coarse entry is only there once all of it is summarised
+    last = std::min(last, frames() / step);
+    if (first >= last) {
+        step = levelFrames(0);
+        level = 0;
+        first = from / step;
+        last = std::min((to + step - 1) / step, frames() / step);
+        if (first >= last) return false;
+    }
+
+    float squares = 0.0f;
+    for (size_t i = first; i < last; ++i) {
+        const Peak* p = entry(level, i);
+        if (i == first) {
+            out = *p;
+            squares = 0.0f;
+        }
+        out.min = std::min(out.min, p->min);
+        out.max = std::max(out.max, p->max);
+        squares += p->rms * p->rms;
+    }
+    out.rms = std::sqrt(squares / (last - first));
+    return true;
+}
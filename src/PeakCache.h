@@ -0,0 +1,76 @@
+#ifndef PEAKCACHE_H
+#define PEAKCACHE_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "AtomicTable.h"
+
+// Min, max and RMS summaries of a take at three resolutions (64, 512 and
+// 4096 frames per entry), so a waveform can be drawn at any zoom from a
+// few thousand values instead of the samples. One thread adds samples as
+// they become available; readers on other threads see every entry below
+// frames(). Storage grows in fixed blocks that never move, like the take
+// itself, and the table of blocks grows in pages with them.
+class PeakCache {
+public:
+    struct Peak {
+        float min;
+        float max;
+        float rms;
+    };
+
+    static const size_t kLevels = 3;
+    static const size_t kBlockFrames = 65536; // frames summarised per storage block
+
+    // Frames per entry at `level`
+    static size_t levelFrames(size_t level) { return size_t(64) << (3 * level); }
+
+    explicit PeakCache(size_t maxFrames);
+    ~PeakCache();
+
+    PeakCache(const PeakCache&) = delete;
+    PeakCache& operator=(const PeakCache&) = delete;
+
+    // Writer: summarise the next `frames` samples of the take
+    void add(const float* samples, size_t frames);
+    // Writer: append a fine entry summarised elsewhere. Only valid while
+    // fed() is a multiple of levelFrames(0).
+    void addEntry(const Peak& peak);
+    // Writer: frames summarised so far, including a partly filled entry
+    size_t fed() const { return entries * levelFrames(0) + accFrames; }
+    // Frames covered by finished entries
+    size_t frames() const { return complete.load(std::memory_order_acquire); }
+
+    // Summary of frames [from, to), read from the coarsest level whose
+    // entries fit in the range. False if nothing there is summarised yet.
+    bool range(size_t from, size_t to, Peak& out) const;
+
+    // Drop every summary; the writer must not be running. Storage blocks
+    // are kept for the next take and only freed with the cache, so a
+    // reader still inside range() never touches freed memory (at worst it
+    // draws entries that are being rewritten).
+    void clear();
+
+private:
+    struct Block;
+
+    Peak* entry(size_t level, size_t index) const;
+    // Fill the coarser entry that ends with finest entry `index`
+    void finishEntry(size_t level, size_t index);
+
+    AtomicTable<Block> blocks;
+    std::atomic<size_t> complete;
+
+    // Writer state: finished fine entries and the one being filled
+    size_t entries;
+    float accMin;
+    float accMax;
+    double accSquares;
+    size_t accFrames;
+};
+
+#endif // PEAKCACHE_H
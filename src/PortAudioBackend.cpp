@@ -0,0 +1,95 @@
+#include "PortAudioBackend.h"
+#include "AudioEngine.h"
+#include <portaudio.h>
+
+static int paCallback( const void *inputBuffer, void *outputBuffer,
+                       unsigned long framesPerBuffer,
+                       const PaStreamCallbackTimeInfo* timeInfo,
+                       PaStreamCallbackFlags statusFlags,
+                       void *userData )
+{
+    (void) timeInfo; /* Prevent unused variable warnings. */
+    (void) inputBuffer;
+
+    AudioBackend::Client* client = static_cast<AudioBackend::Client*>(userData);
+    client->renderAudio(static_cast<float*>(outputBuffer), framesPerBuffer,
+                        (statusFlags & (paOutputUnderflow | paOutputOverflow)) != 0);
+    return paContinue;
+}
+
+PortAudioBackend::PortAudioBackend() : stream(NULL), initialized(false), latency(0.0) {}
+
+PortAudioBackend::~PortAudioBackend()
+{
+    close();
+    if (initialized) Pa_Terminate();
+}
+
+bool PortAudioBackend::initialize(std::string& error)
+{
+    PaError err = Pa_Initialize();
+    if( err != paNoError ) {
+        error = std::string("PortAudio: ") + Pa_GetErrorText(err);
+        return false;
+    }
+    initialized = true;
+    return true;
+}
+
+bool PortAudioBackend::open(const AudioSettings& settings, Client& client, std::string& error)
+{
+    close();
+
+    PaStreamParameters outputParameters;
+    outputParameters.device = Pa_GetDefaultOutputDevice(); /* default output device */
+    if (outputParameters.device == paNoDevice) {
+        error = "PortAudio: no default output device";
+        return false;
+    }
+    const PaDeviceInfo* info = Pa_GetDeviceInfo( outputParameters.device );
+    outputParameters.channelCount = 2;       /* stereo output */
+    outputParameters.sampleFormat = paFloat32; /* 32 bit floating point output */
+    outputParameters.suggestedLatency = settings.lowLatency ? info->defaultLowOutputLatency
+                                                            : info->defaultHighOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    PaStream* s = NULL;
+    PaError err = Pa_OpenStream(
+              &s,
+              NULL, /* no input */
+              &outputParameters,
+              settings.sampleRate,
+              settings.framesPerBuffer,
+              paClipOff,      /* we won't output out of range samples so don't bother clipping them */
+              paCallback,
+              &client );
+    if( err == paNoError ) err = Pa_StartStream( s );
+    if( err != paNoError ) {
+        error = std::string("PortAudio: ") + Pa_GetErrorText(err);
+        if (s) Pa_CloseStream( s );
+        return false;
+    }
+
+    const PaStreamInfo* streamInfo = Pa_GetStreamInfo( s );
+    latency = streamInfo ? streamInfo->outputLatency : 0.0;
+    stream = s;
+    return true;
+}
+
+void PortAudioBackend::close()
+{
+    if (!stream) return;
+    Pa_StopStream( stream );
+    Pa_CloseStream( stream );
+    stream = NULL;
+}
+
+double PortAudioBackend::getOutputLatency() const
+{
+    return latency;
+}
+
+const char* PortAudioBackend::getName() const
+{
+    return "portaudio";
+}
@@ -0,0 +1,28 @@
+#ifndef PORTAUDIOBACKEND_H
+#define PORTAUDIOBACKEND_H
+
+#pragma once
+
+#include "AudioBackend.h"
+
+// Plays through the default PortAudio output device
+class PortAudioBackend : public AudioBackend {
+public:
+    PortAudioBackend();
+    ~PortAudioBackend();
+
+    // True if Pa_Initialize() succeeded; otherwise `error` holds the reason
+    bool initialize(std::string& error);
+
+    bool open(const AudioSettings& settings, Client& client, std::string& error) override;
+    void close() override;
+    double getOutputLatency() const override;
+    const char* getName() const override;
+
+private:
+    void* stream; // PaStream
+    bool initialized;
+    double latency;
+};
+
+#endif // PORTAUDIOBACKEND_H
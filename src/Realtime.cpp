@@ -0,0 +1,137 @@
+#include "Realtime.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+// Nice level used when no real-time policy is allowed
+static const int kFallbackNice = -10;
+
+ThreadId currentThreadId()
+{
+    ThreadId id;
+#if defined(__unix__) || defined(__APPLE__)
+    id.handle = pthread_self();
+#else
+    id.handle = std::thread::native_handle_type();
+#endif
+#if defined(__linux__)
+    id.systemId = static_cast<long>(syscall(SYS_gettid));
+#else
+    id.systemId = 0;
+#endif
+    return id;
+}
+
+std::string promoteCurrentThread(int priority)
+{
+    return promoteThread(currentThreadId(), priority);
+}
+
+std::string promoteThread(const ThreadId& thread, int priority)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (priority <= 0) return "default scheduling";
+
+    const int policies[] = { SCHED_FIFO, SCHED_RR };
+    const char* names[] = { "SCHED_FIFO", "SCHED_RR" };
+    int err = 0;
+    for (int i = 0; i < 2; ++i) {
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        int lo = sched_get_priority_min(policies[i]);
+        int hi = sched_get_priority_max(policies[i]);
+        param.sched_priority = priority < lo ? lo : (priority > hi ? hi : priority);
+        err = pthread_setschedparam(thread.handle, policies[i], &param);
+        if (err == 0) {
+            return std::string(names[i]) + " priority " + std::to_string(param.sched_priority);
+        }
+    }
+
+#if defined(__linux__)
+    // Without RLIMIT_RTPRIO a raised nice level is the best we can get; on
+    // Linux it applies to the one thread only
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(thread.systemId), kFallbackNice) == 0) {
+        return "nice " + std::to_string(kFallbackNice) + " (real-time denied: " + std::strerror(err) + ")";
+    }
+#endif
+    return std::string("default scheduling (real-time denied: ") + std::strerror(err) + ")";
+#else
+    (void) thread;
+    (void) priority;
+    (void) kFallbackNice;
+    return "default scheduling (not supported on this platform)";
+#endif
+}
+
+std::string pinCurrentThread(const std::vector<int>& cpus)
+{
+    return pinThread(currentThreadId(), cpus);
+}
+
+std::string pinThread(const ThreadId& thread, const std::vector<int>& cpus)
+{
+    if (cpus.empty()) return "any core";
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::ostringstream list;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE) continue;
+        CPU_SET(cpus[i], &set);
+        list << (i ? "," : "") << cpus[i];
+    }
+    int err = pthread_setaffinity_np(thread.handle, sizeof(set), &set);
+    if (err != 0) {
+        return std::string("any core (affinity denied: ") + std::strerror(err) + ")";
+    }
+    return "cores " + list.str();
+#else
+    (void) thread;
+    return "any core (affinity not supported on this platform)";
+#endif
+}
+
+std::string lockProcessMemory()
+{
+#if defined(__unix__) || defined(__APPLE__)
+#if defined(MCL_ONFAULT)
+    // Lock pages as they are touched rather than all at once, so mapped
+    // track files are not read into RAM in full
+    if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) == 0) {
+        return "memory locked on fault";
+    }
+#endif
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        return std::string("memory not locked: ") + std::strerror(errno);
+    }
+    return "memory locked";
+#else
+    return "memory locking not supported on this platform";
+#endif
+}
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus)
+{
+    cpus.clear();
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        char* end = nullptr;
+        long cpu = std::strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || cpu < 0 || cpu > 1023) return false;
+        cpus.push_back(static_cast<int>(cpu));
+    }
+    return !cpus.empty();
+}
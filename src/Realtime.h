@@ -0,0 +1,39 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+// Helpers for giving the audio path real-time treatment. Each returns a
+// short human-readable description of what was actually granted.
+
+// Identifies a thread so another one can promote or pin it, e.g. a
+// device callback thread that must not make the calls itself
+struct ThreadId {
+    std::thread::native_handle_type handle;
+    long systemId; // kernel thread id where there is one, for the nice fallback
+};
+
+// Cheap enough for a real-time callback: no allocation or locking
+ThreadId currentThreadId();
+
+// Ask for SCHED_FIFO at `priority`, falling back to SCHED_RR and then to
+// a raised nice level when the process lacks the rights
+std::string promoteThread(const ThreadId& thread, int priority);
+std::string promoteCurrentThread(int priority);
+
+// Restrict a thread to the given CPU cores
+std::string pinThread(const ThreadId& thread, const std::vector<int>& cpus);
+std::string pinCurrentThread(const std::vector<int>& cpus);
+
+// Lock current and future pages into RAM so the audio path never faults
+std::string lockProcessMemory();
+
+// Parse a comma separated core list such as "2,3". Returns false on
+// malformed input.
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+
+#endif // REALTIME_H
@@ -0,0 +1,328 @@
+#include "RealtimeGuard.h"
+
+#if defined(SYNTH_RT_GUARD)
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// glibc's own allocator entry points, so the malloc family can be
+// replaced without dlsym (which itself allocates)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+void* __libc_pvalloc(size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace {
+
+enum Mode { ModeOff, ModeLog, ModeAbort };
+
+// Depth of nested real-time sections and allowances on this thread, and
+// whether the thread is already inside a report (reporting may call
+// hooked functions)
+thread_local int realtimeDepth = 0;
+thread_local int allowanceDepth = 0;
+thread_local bool reporting = false;
+
+std::atomic<int> mode(ModeLog);
+std::atomic<uint64_t> violations(0);
+std::atomic<uint64_t> busyLocks(0);
+
+// Call sites already reported; fixed size so recording one never allocates
+const int kMaxSites = 256;
+std::atomic<void*> sites[kMaxSites];
+
+typedef ssize_t (*WriteFn)(int, const void*, size_t);
+
+std::atomic<WriteFn> writeSlot(nullptr);
+WriteFn realWrite();
+
+void writeText(const char* text)
+{
+    realWrite()(STDERR_FILENO, text, strlen(text));
+}
+
+// True the first time `site` is seen
+bool firstTimeAt(void* site)
+{
+    for (int i = 0; i < kMaxSites; ++i) {
+        void* current = sites[i].load(std::memory_order_acquire);
+        if (current == site) return false;
+        if (current == nullptr) {
+            if (sites[i].compare_exchange_strong(current, site)) return true;
+            if (current == site) return false;
+        }
+    }
+    return false;
+}
+
+void violation(const char* what, void* site)
+{
+    if (reporting || realtimeDepth == 0 || allowanceDepth > 0 ||
+        mode.load(std::memory_order_relaxed) == ModeOff) return;
+    reporting = true;
+    violations.fetch_add(1, std::memory_order_relaxed);
+
+    bool abortNow = mode.load(std::memory_order_relaxed) == ModeAbort;
+    if (abortNow || firstTimeAt(site)) {
+        writeText("RT guard: ");
+        writeText(what);
+        writeText(" on the audio thread\n");
+        void* frames[32];
+        int count = backtrace(frames, 32);
+        // Skip the guard's own frames
+        backtrace_symbols_fd(frames + 2, count > 2 ? count - 2 : 0, STDERR_FILENO);
+        writeText("\n");
+    }
+    if (abortNow) abort();
+    reporting = false;
+}
+
+// Look up the next definition of a hooked function. The slot is a plain
+// atomic rather than a function-local static because guarded static
+// initialisation may itself lock a mutex.
+template <typename Fn>
+Fn next(std::atomic<Fn>& slot, const char* name)
+{
+    Fn f = slot.load(std::memory_order_acquire);
+    if (!f) {
+        f = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+        slot.store(f, std::memory_order_release);
+    }
+    return f;
+}
+
+WriteFn realWrite()
+{
+    return next(writeSlot, "write");
+}
+
+// Read the mode and warm up backtrace(), which loads libgcc on first use
+struct Init {
+    Init()
+    {
+        const char* env = getenv("SYNTH_RT_GUARD");
+        if (env && strcmp(env, "abort") == 0) mode = ModeAbort;
+        else if (env && strcmp(env, "off") == 0) mode = ModeOff;
+        void* frames[1];
+        backtrace(frames, 1);
+        realWrite();
+    }
+
+    ~Init()
+    {
+        uint64_t count = violations.load();
+        if (count > 0) {
+            fprintf(stderr, "RT guard: %llu real-time violation(s) in total\n",
+                    static_cast<unsigned long long>(count));
+        }
+        uint64_t busy = busyLocks.load();
+        if (busy > 0) {
+            fprintf(stderr, "RT guard: %llu block(s) found a lock busy\n",
+                    static_cast<unsigned long long>(busy));
+        }
+    }
+} init;
+
+} // namespace
+
+ScopedRealtimeSection::ScopedRealtimeSection()
+{
+    ++realtimeDepth;
+}
+
+ScopedRealtimeSection::~ScopedRealtimeSection()
+{
+    --realtimeDepth;
+}
+
+ScopedRealtimeAllowance::ScopedRealtimeAllowance()
+{
+    ++allowanceDepth;
+}
+
+ScopedRealtimeAllowance::~ScopedRealtimeAllowance()
+{
+    --allowanceDepth;
+}
+
+uint64_t realtimeViolationCount()
+{
+    return violations.load(std::memory_order_relaxed);
+}
+
+void realtimeLockBusy(const char* lock)
+{
+    if (reporting || realtimeDepth == 0 || mode.load(std::memory_order_relaxed) == ModeOff) return;
+    reporting = true;
+    busyLocks.fetch_add(1, std::memory_order_relaxed);
+    if (firstTimeAt(__builtin_return_address(0))) {
+        writeText("RT guard: ");
+        writeText(lock);
+        writeText(" was busy; the audio thread went without it\n");
+    }
+    reporting = false;
+}
+
+uint64_t realtimeLockBusyCount()
+{
+    return busyLocks.load(std::memory_order_relaxed);
+}
+
+#define SITE __builtin_return_address(0)
+
+// operator new and delete end up here as well
+extern "C" void* malloc(size_t size)
+{
+    violation("malloc", SITE);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    violation("calloc", SITE);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    violation("realloc", SITE);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+    if (ptr) violation("free", SITE);
+    __libc_free(ptr);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    violation("posix_memalign", SITE);
+    void* p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+    violation("aligned_alloc", SITE);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size)
+{
+    violation("memalign", SITE);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* valloc(size_t size)
+{
+    violation("valloc", SITE);
+    return __libc_valloc(size);
+}
+
+extern "C" void* pvalloc(size_t size)
+{
+    violation("pvalloc", SITE);
+    return __libc_pvalloc(size);
+}
+
+typedef int (*MutexLockFn)(pthread_mutex_t*);
+typedef int (*CondWaitFn)(pthread_cond_t*, pthread_mutex_t*);
+typedef int (*CondTimedWaitFn)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*);
+typedef int (*NanosleepFn)(const struct timespec*, struct timespec*);
+typedef int (*ClockNanosleepFn)(clockid_t, int, const struct timespec*, struct timespec*);
+typedef int (*UsleepFn)(useconds_t);
+typedef ssize_t (*ReadFn)(int, void*, size_t);
+typedef FILE* (*FopenFn)(const char*, const char*);
+typedef int (*FsyncFn)(int);
+
+static std::atomic<MutexLockFn> mutexLockSlot(nullptr);
+static std::atomic<CondWaitFn> condWaitSlot(nullptr);
+static std::atomic<CondTimedWaitFn> condTimedWaitSlot(nullptr);
+static std::atomic<NanosleepFn> nanosleepSlot(nullptr);
+static std::atomic<ClockNanosleepFn> clockNanosleepSlot(nullptr);
+static std::atomic<UsleepFn> usleepSlot(nullptr);
+static std::atomic<ReadFn> readSlot(nullptr);
+static std::atomic<FopenFn> fopenSlot(nullptr);
+static std::atomic<FsyncFn> fsyncSlot(nullptr);
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    violation("pthread_mutex_lock", SITE);
+    return next(mutexLockSlot, "pthread_mutex_lock")(mutex);
+}
+
+extern "C" int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    violation("pthread_cond_wait", SITE);
+    return next(condWaitSlot, "pthread_cond_wait")(cond, mutex);
+}
+
+extern "C" int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex,
+                                      const struct timespec* abstime)
+{
+    violation("pthread_cond_timedwait", SITE);
+    return next(condTimedWaitSlot, "pthread_cond_timedwait")(cond, mutex, abstime);
+}
+
+extern "C" int nanosleep(const struct timespec* request, struct timespec* remaining)
+{
+    violation("nanosleep", SITE);
+    return next(nanosleepSlot, "nanosleep")(request, remaining);
+}
+
+extern "C" int clock_nanosleep(clockid_t clock, int flags, const struct timespec* request,
+                               struct timespec* remaining)
+{
+    violation("clock_nanosleep", SITE);
+    return next(clockNanosleepSlot, "clock_nanosleep")(clock, flags, request, remaining);
+}
+
+extern "C" int usleep(useconds_t usec)
+{
+    violation("usleep", SITE);
+    return next(usleepSlot, "usleep")(usec);
+}
+
+extern "C" ssize_t read(int fd, void* buffer, size_t count)
+{
+    violation("read", SITE);
+    return next(readSlot, "read")(fd, buffer, count);
+}
+
+extern "C" ssize_t write(int fd, const void* buffer, size_t count)
+{
+    violation("write", SITE);
+    return realWrite()(fd, buffer, count);
+}
+
+extern "C" FILE* fopen(const char* path, const char* modeText)
+{
+    violation("fopen", SITE);
+    return next(fopenSlot, "fopen")(path, modeText);
+}
+
+extern "C" int fsync(int fd)
+{
+    violation("fsync", SITE);
+    return next(fsyncSlot, "fsync")(fd);
+}
+
+#endif // SYNTH_RT_GUARD
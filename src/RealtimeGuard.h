@@ -0,0 +1,68 @@
+#ifndef REALTIME_GUARD_H
+#define REALTIME_GUARD_H
+
+#pragma once
+
+#include <cstdint>
+
+// Real-time safety checker. In builds with SYNTH_RT_GUARD defined
+// (RT_GUARD=1 ./make.sh) heap allocation, mutex locks and blocking calls
+// made while a thread is inside a ScopedRealtimeSection, and not inside a
+// ScopedRealtimeAllowance, are reported with a stack trace, once per call
+// site. Set SYNTH_RT_GUARD=abort in the
+// environment to abort on the first one instead, or =off to disable.
+// In normal builds everything here compiles away.
+
+#if defined(SYNTH_RT_GUARD)
+
+// Marks the calling thread as real-time while in scope; sections nest
+class ScopedRealtimeSection {
+public:
+    ScopedRealtimeSection();
+    ~ScopedRealtimeSection();
+
+    ScopedRealtimeSection(const ScopedRealtimeSection&) = delete;
+    ScopedRealtimeSection& operator=(const ScopedRealtimeSection&) = delete;
+};
+
+// Allows what would otherwise be a violation while in scope, for the few
+// calls the design accepts on the audio thread (the worker pool's blocking
+// fallback). Keep these scopes as narrow as the call.
+class ScopedRealtimeAllowance {
+public:
+    ScopedRealtimeAllowance();
+    ~ScopedRealtimeAllowance();
+
+    ScopedRealtimeAllowance(const ScopedRealtimeAllowance&) = delete;
+    ScopedRealtimeAllowance& operator=(const ScopedRealtimeAllowance&) = delete;
+};
+
+// Violations seen so far, including repeats from the same call site
+uint64_t realtimeViolationCount();
+
+// A lock the audio thread only tries (the render lock) was held by
+// another thread, so the block went without it. Nothing waited, so this
+// is not a violation and never aborts, but each call site is logged once
+// and the total printed at exit, to show which edits cost dropouts.
+void realtimeLockBusy(const char* lock);
+uint64_t realtimeLockBusyCount();
+
+#else
+
+class ScopedRealtimeSection {
+public:
+    ScopedRealtimeSection() {}
+};
+
+class ScopedRealtimeAllowance {
+public:
+    ScopedRealtimeAllowance() {}
+};
+
+inline uint64_t realtimeViolationCount() { return 0; }
+inline void realtimeLockBusy(const char*) {}
+inline uint64_t realtimeLockBusyCount() { return 0; }
+
+#endif
+
+#endif // REALTIME_GUARD_H
@@ -0,0 +1,600 @@
+#include "RecordBuffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const size_t RecordBuffer::kChunkFrames;
+const size_t RecordBuffer::kMaxChunks;
+const size_t RecordBuffer::kSpareChunks;
+const size_t RecordBuffer::kReadAheadChunks;
+const size_t RecordBuffer::kWriteFrames;
+const size_t RecordBuffer::kPeakEntries;
+
+// Most frames summarised per stream() call, so opening a long file doesn't
+// hold up spooling for long
+static const size_t kPeakFramesPerPass = 1 << 22;
+
+RecordBuffer::RecordBuffer()
+    : chunks(kMaxChunks), length(0), dropped(0),
+      spareHead(0), spareTail(0), pathVersion(1), mapping(nullptr), mappingBytes(0), spoolFd(-1), fileMapped(0),
+      dataOffset(WavWriter::kDataOffset), flushed(0), peakCache(kMaxChunks * kChunkFrames), peakHead(0), peakTail(0), liveSquares(0.0),
+      liveFrames(0)
+{
+    for (auto &s : spares) s.store(nullptr);
+}
+
+RecordBuffer::~RecordBuffer()
+{
+    clear();
+    releaseSpares();
+}
+
+void RecordBuffer::releaseSpares()
+{
+    while (float* chunk = takeSpare()) {
+        delete[] chunk;
+    }
+}
+
+void RecordBuffer::append(const float* samples, size_t frames)
+{
+    size_t pos = length.load(std::memory_order_relaxed);
+    while (frames > 0) {
+        size_t index = pos / kChunkFrames;
+        size_t offset = pos % kChunkFrames;
+        if (index >= kMaxChunks) break;
+        std::atomic<float*>* slot = chunks.find(index);
+        if (!slot) break;
+        float* chunk = slot->load(std::memory_order_relaxed);
+        if (!chunk) {
+            chunk = takeSpare();
+            if (!chunk) break;
+            slot->store(chunk, std::memory_order_release);
+        }
+        size_t n = std::min(frames, kChunkFrames - offset);
+        std::memcpy(chunk + offset, samples, n * sizeof(float));
+        summarise(samples, n, pos);
+        samples += n;
+        frames -= n;
+        pos += n;
+    }
+    if (frames > 0) {
+        dropped.fetch_add(frames, std::memory_order_relaxed);
+    }
+    length.store(pos, std::memory_order_release);
+}
+
+void RecordBuffer::summarise(const float* samples, size_t frames, size_t pos)
+{
+    if (!peakRing) return;
+    const size_t entryFrames = PeakCache::levelFrames(0);
+    for (size_t i = 0; i < frames; ++i) {
+        float s = samples[i];
+        if (liveFrames == 0) {
+            livePeak.min = livePeak.max = s;
+            liveSquares = 0.0;
+        }
+        livePeak.min = std::min(livePeak.min, s);
+        livePeak.max = std::max(livePeak.max, s);
+        liveSquares += static_cast<double>(s) * s;
+        if (++liveFrames < entryFrames) continue;
+
+        livePeak.rms = static_cast<float>(std::sqrt(liveSquares / entryFrames));
+        liveFrames = 0;
+        // A full ring drops the entry; the disk thread then reads the
+        // samples instead
+        size_t head = peakHead.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % kPeakEntries;
+        if (next != peakTail.load(std::memory_order_acquire)) {
+            peakRing[head].index = (pos + i + 1) / entryFrames - 1;
+            peakRing[head].peak = livePeak;
+            peakHead.store(next, std::memory_order_release);
+        }
+    }
+}
+
+void RecordBuffer::read(size_t start, float* out, size_t frames) const
+{
+    while (frames > 0) {
+        size_t offset = start % kChunkFrames;
+        size_t n = std::min(frames, kChunkFrames - offset);
+        const float* chunk = chunks.load(start / kChunkFrames);
+        if (chunk) {
+            std::memcpy(out, chunk + offset, n * sizeof(float));
+        } else {
+            std::fill(out, out + n, 0.0f);
+        }
+        out += n;
+        start += n;
+        frames -= n;
+    }
+}
+
+float* RecordBuffer::takeSpare()
+{
+    size_t tail = spareTail.load(std::memory_order_relaxed);
+    if (tail == spareHead.load(std::memory_order_acquire)) return nullptr;
+    float* chunk = spares[tail].load(std::memory_order_relaxed);
+    spareTail.store((tail + 1) % (kSpareChunks + 1), std::memory_order_release);
+    return chunk;
+}
+
+void RecordBuffer::refill()
+{
+    // Set up before the first refill returns, which is before recording
+    // into this buffer starts
+    if (!peakRing) peakRing.reset(new PeakEntry[kPeakEntries]);
+    // The audio thread can't page in the chunk table, so slots for the
+    // chunks the spares will fill exist before they are needed
+    size_t first = size() / kChunkFrames;
+    for (size_t i = first; i <= first + kSpareChunks && i < kMaxChunks; ++i) {
+        chunks.slot(i);
+    }
+    for (;;) {
+        size_t head = spareHead.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % (kSpareChunks + 1);
+        if (next == spareTail.load(std::memory_order_acquire)) return;
+        spares[head].store(new float[kChunkFrames], std::memory_order_relaxed);
+        spareHead.store(next, std::memory_order_release);
+    }
+}
+
+bool RecordBuffer::needsSpool() const
+{
+    std::lock_guard<std::mutex> lock(diskMutex);
+    return path.empty() && size() > 0;
+}
+
+void RecordBuffer::startSpool(const std::string& file, double sampleRate)
+{
+    std::lock_guard<std::mutex> lock(diskMutex);
+    // Another thread (an offline render's pass) may have got here first
+    if (!path.empty()) return;
+    std::unique_ptr<WavWriter> w(new WavWriter(file, sampleRate, 1));
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file for reading: " + file);
+    }
+    // Reserve room for the longest possible take up front, so chunk
+    // pointers into the mapping never move; the file is mapped into it as
+    // it is written, since touching a page past its end raises SIGBUS
+    try {
+        reserveMapping(WavWriter::kDataOffset + kMaxChunks * kChunkFrames * sizeof(float));
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    writer.swap(w);
+    path = file;
+    pathVersion.fetch_add(1, std::memory_order_release);
+    spoolFd = fd;
+    dataOffset = WavWriter::kDataOffset;
+    flushed = 0;
+}
+
+// Little-endian header fields
+static uint32_t get32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint16_t get16(const unsigned char* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+void RecordBuffer::openFile(const std::string& file, double sampleRate)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Could not open file for reading: " + file);
+    }
+    unsigned char riff[12];
+    if (!in.read(reinterpret_cast<char*>(riff), 12) ||
+        std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+        throw std::runtime_error(file + " is not a WAV file");
+    }
+
+    // Walk the chunks for the format and the sample data
+    bool haveFormat = false;
+    uint16_t formatTag = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    size_t offset = 12, dataBytes = 0;
+    bool haveData = false;
+    unsigned char header[8];
+    while (!haveData && in.read(reinterpret_cast<char*>(header), 8)) {
+        uint32_t size = get32(header + 4);
+        offset += 8;
+        if (std::memcmp(header, "fmt ", 4) == 0 && size >= 16) {
+            unsigned char fmt[16];
+            in.read(reinterpret_cast<char*>(fmt), 16);
+            formatTag = get16(fmt);
+            channels = get16(fmt + 2);
+            rate = get32(fmt + 4);
+            bits = get16(fmt + 14);
+            haveFormat = true;
+        } else if (std::memcmp(header, "data", 4) == 0) {
+            dataBytes = size;
+            haveData = true;
+            break;
+        }
+        offset += size + (size & 1);
+        in.seekg(offset);
+    }
+    if (!haveFormat || !haveData || formatTag != 3 || channels != 1 || bits != 32 || offset % 4 != 0) {
+        throw std::runtime_error(file + ": only mono 32-bit float WAV files can be opened");
+    }
+    if (rate != static_cast<uint32_t>(sampleRate)) {
+        throw std::runtime_error(file + " is at " + std::to_string(rate) + " Hz, the engine runs at " +
+                                 std::to_string(static_cast<uint32_t>(sampleRate)) + " Hz");
+    }
+
+    // The size field is unreliable in files that were never finished
+    int fd = ::open(file.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error("Could not open file for reading: " + file);
+    }
+    size_t fileBytes = static_cast<size_t>(st.st_size);
+    if (dataBytes == 0 || offset + dataBytes > fileBytes) {
+        dataBytes = fileBytes > offset ? fileBytes - offset : 0;
+    }
+    size_t frames = std::min(dataBytes / sizeof(float), kMaxChunks * kChunkFrames);
+
+    clear();
+    std::lock_guard<std::mutex> lock(diskMutex);
+    try {
+        mapFile(fd, fileBytes);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    path = file;
+    pathVersion.fetch_add(1, std::memory_order_release);
+    dataOffset = offset;
+    flushed = frames;
+    length.store(frames, std::memory_order_release);
+}
+
+void RecordBuffer::mapFile(int fd, size_t bytes)
+{
+    void* p = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error("Could not map file: " + std::string(std::strerror(errno)));
+    }
+    mapping = static_cast<char*>(p);
+    mappingBytes = bytes;
+}
+
+void RecordBuffer::reserveMapping(size_t bytes)
+{
+    size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    bytes = (bytes + page - 1) / page * page;
+    void* p = ::mmap(nullptr, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error("Could not map file: " + std::string(std::strerror(errno)));
+    }
+    mapping = static_cast<char*>(p);
+    mappingBytes = bytes;
+    fileMapped = 0;
+}
+
+void RecordBuffer::growMapping(size_t frames)
+{
+    // Whole pages from the end of the last piece; the page holding the end
+    // of the file may run past it, which reads as zeros rather than faulting
+    size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t end = (dataOffset + frames * sizeof(float) + page - 1) / page * page;
+    end = std::min(end, mappingBytes);
+    if (spoolFd < 0 || end <= fileMapped) return;
+    void* p = ::mmap(mapping + fileMapped, end - fileMapped, PROT_READ, MAP_SHARED | MAP_FIXED,
+                     spoolFd, static_cast<off_t>(fileMapped));
+    if (p == MAP_FAILED) {
+        throw std::runtime_error("Could not map file: " + std::string(std::strerror(errno)));
+    }
+    fileMapped = end;
+}
+
+float* RecordBuffer::mappedChunk(size_t index) const
+{
+    return reinterpret_cast<float*>(mapping + dataOffset + index * kChunkFrames * sizeof(float));
+}
+
+bool RecordBuffer::isMapped(const float* chunk) const
+{
+    const char* p = reinterpret_cast<const char*>(chunk);
+    return mapping && p >= mapping && p < mapping + mappingBytes;
+}
+
+void RecordBuffer::pin(const float* samples, size_t frames)
+{
+    size_t bytes = frames * sizeof(float);
+    if (::mlock(samples, bytes) == 0) return;
+    // Over the lock limit: fault the pages in and hope they stay
+    long page = ::sysconf(_SC_PAGESIZE);
+    const volatile char* p = reinterpret_cast<const volatile char*>(samples);
+    for (size_t i = 0; i < bytes; i += page) {
+        (void) p[i];
+    }
+}
+
+void RecordBuffer::unpin(const float* samples, size_t frames)
+{
+    // Only whole pages inside the range; the ones at the edges may belong
+    // to a neighbouring chunk that is still pinned
+    uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    uintptr_t begin = (reinterpret_cast<uintptr_t>(samples) + page - 1) & ~(page - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(samples + frames)) & ~(page - 1);
+    if (end <= begin) return;
+    ::munlock(reinterpret_cast<void*>(begin), end - begin);
+    ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+}
+
+void RecordBuffer::unpinEvicted(size_t index)
+{
+    std::lock_guard<std::mutex> lock(diskMutex);
+    // The take may have been cleared, or reopened from another file
+    if (!mapping || index * kChunkFrames >= flushed) return;
+    float* mapped = mappedChunk(index);
+    if (chunks.load(index) != mapped) {
+        unpin(mapped, std::min(kChunkFrames, flushed - index * kChunkFrames));
+    }
+}
+
+void RecordBuffer::Evicted::release()
+{
+    for (float* chunk : chunks) delete[] chunk;
+    for (auto &m : mapped) m.first->unpinEvicted(m.second);
+    chunks.clear();
+    mapped.clear();
+}
+
+void RecordBuffer::stream(const StreamState& state, Evicted& evicted)
+{
+    std::lock_guard<std::mutex> lock(diskMutex);
+    updatePeaks(size(), state.recording);
+    if (path.empty()) return;
+
+    // Write in large sequential pieces while recording, everything once
+    // the take is finished
+    size_t available = size();
+    if (writer && (available - flushed >= kWriteFrames || (!state.recording && available > flushed))) {
+        writePending(available);
+    }
+
+    // Chunks still being filled or written stay on the heap. Once on disk
+    // a chunk is served from the mapping while it is in the pinned window
+    // (the start of the take, the chunks being played and, when looping,
+    // the ones after the loop start, so a wrap never lands on chunks that
+    // are not resident) and dropped otherwise; a take opened from a file
+    // has its last chunk on disk too.
+    size_t used = (available + kChunkFrames - 1) / kChunkFrames;
+    size_t playFirst = state.playPosition / kChunkFrames;
+    size_t playLast = std::min(used, playFirst + kReadAheadChunks + 1);
+    size_t loopFirst = state.loopPosition / kChunkFrames;
+    size_t loopLast = std::min(used, loopFirst + kReadAheadChunks + 1);
+    for (size_t i = 0; i < used; ++i) {
+        bool onDisk = (i + 1) * kChunkFrames <= flushed || (!writer && flushed == available);
+        if (!onDisk) continue;
+        bool wanted = i <= kReadAheadChunks || (state.playing && i >= playFirst && i < playLast) ||
+                      (state.playing && state.looping && i >= loopFirst && i < loopLast);
+        size_t frames = std::min(kChunkFrames, available - i * kChunkFrames);
+        std::atomic<float*>& slot = chunks.slot(i);
+        float* current = slot.load(std::memory_order_acquire);
+        float* mapped = mappedChunk(i);
+        if (wanted && current != mapped) {
+            pin(mapped, frames);
+            slot.store(mapped, std::memory_order_release);
+            if (current) evicted.chunks.push_back(current);
+        } else if (!wanted && current) {
+            slot.store(nullptr, std::memory_order_release);
+            // Like a heap chunk, a mapped one may still be being read: only
+            // unpin it (which drops its pages) after the handshake
+            if (current == mapped) {
+                evicted.mapped.push_back(std::make_pair(this, i));
+            } else {
+                evicted.chunks.push_back(current);
+            }
+        }
+    }
+
+    // Ask the kernel to start reading what comes after the pinned window
+    if (state.playing && playLast < used) {
+        size_t aheadEnd = std::min(used, playLast + kReadAheadChunks);
+        size_t endFrame = std::min(aheadEnd * kChunkFrames, flushed);
+        if (endFrame > playLast * kChunkFrames) {
+            uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+            uintptr_t begin = reinterpret_cast<uintptr_t>(mappedChunk(playLast)) & ~(page - 1);
+            uintptr_t end = reinterpret_cast<uintptr_t>(mappedChunk(0) + endFrame);
+            ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+        }
+    }
+}
+
+void RecordBuffer::writePending(size_t available)
+{
+    while (flushed < available) {
+        size_t offset = flushed % kChunkFrames;
+        size_t n = std::min(available - flushed, kChunkFrames - offset);
+        writer->write(chunks.load(flushed / kChunkFrames) + offset, n);
+        flushed += n;
+    }
+    writer->flush();
+    growMapping(flushed);
+}
+
+void RecordBuffer::updatePeaks(size_t available, bool recording)
+{
+    size_t budget = kPeakFramesPerPass;
+    // Read samples into the cache up to `until`
+    auto summariseSamples = [&](size_t until) {
+        while (peakCache.fed() < until && budget > 0) {
+            size_t pos = peakCache.fed();
+            size_t index = pos / kChunkFrames;
+            const float* chunk = chunks.load(index);
+            // Chunks that were dropped from memory are still in the file
+            if (!chunk && mapping && pos < flushed) chunk = mappedChunk(index);
+            if (!chunk) break;
+            size_t n = std::min(std::min(until - pos, kChunkFrames - pos % kChunkFrames), budget);
+            peakCache.add(chunk + pos % kChunkFrames, n);
+            budget -= n;
+        }
+    };
+
+    if (peakRing) {
+        size_t tail = peakTail.load(std::memory_order_relaxed);
+        while (tail != peakHead.load(std::memory_order_acquire)) {
+            const PeakEntry& e = peakRing[tail];
+            size_t start = e.index * PeakCache::levelFrames(0);
+            // Entries lost to a full ring are made up from the samples
+            summariseSamples(start);
+            if (peakCache.fed() == start) peakCache.addEntry(e.peak);
+            tail = (tail + 1) % kPeakEntries;
+            peakTail.store(tail, std::memory_order_release);
+        }
+        if (recording) return;
+    }
+    summariseSamples(available);
+}
+
+std::string RecordBuffer::spoolPath() const
+{
+    std::lock_guard<std::mutex> lock(diskMutex);
+    return path;
+}
+
+bool RecordBuffer::tryGetSpoolPath(std::string& out) const
+{
+    std::unique_lock<std::mutex> lock(diskMutex, std::try_to_lock);
+    if (!lock.owns_lock()) return false;
+    out = path;
+    return true;
+}
+
+void RecordBuffer::clear()
+{
+    std::lock_guard<std::mutex> lock(diskMutex);
+    if (writer) {
+        // Leave a complete, valid file behind
+        try {
+            writePending(size());
+        } catch (const std::exception&) {
+        }
+        writer->close();
+        writer.reset();
+    }
+    for (size_t i = 0; i < kMaxChunks; ++i) {
+        std::atomic<float*>* slot = chunks.find(i);
+        if (!slot) continue;
+        float* chunk = slot->exchange(nullptr);
+        if (!isMapped(chunk)) delete[] chunk;
+    }
+    if (mapping) {
+        ::munmap(mapping, mappingBytes);
+        mapping = nullptr;
+        mappingBytes = 0;
+    }
+    if (spoolFd >= 0) {
+        ::close(spoolFd);
+        spoolFd = -1;
+    }
+    fileMapped = 0;
+    if (!path.empty()) {
+        path.clear();
+        pathVersion.fetch_add(1, std::memory_order_release);
+    }
+    flushed = 0;
+    peakCache.clear();
+    peakTail.store(peakHead.load());
+    liveFrames = 0;
+    length.store(0, std::memory_order_release);
+    dropped.store(0, std::memory_order_relaxed);
+}
+
+void RecordBuffer::resample(double ratio, double sampleRate, const std::string& file)
+{
+    size_t count = std::min(static_cast<size_t>(size() * ratio), kMaxChunks * kChunkFrames);
+    if (ratio == 1.0 || count == 0) return;
+
+    bool toFile = false;
+    std::vector<float*> converted; // chunks of a take that lives in memory
+    {
+        std::lock_guard<std::mutex> lock(diskMutex);
+        toFile = !path.empty();
+        std::unique_ptr<WavWriter> out;
+        if (toFile) out.reset(new WavWriter(file, sampleRate, 1));
+        std::vector<float> block(toFile ? kChunkFrames : 0);
+
+        // Chunks that are not resident are read from the mapping
+        size_t last = size() - 1;
+        auto sample = [&](size_t i) {
+            size_t index = i / kChunkFrames;
+            const float* chunk = chunks.load(index);
+            if (!chunk) chunk = mappedChunk(index);
+            return chunk[i % kChunkFrames];
+        };
+        for (size_t pos = 0; pos < count; pos += kChunkFrames) {
+            size_t n = std::min(kChunkFrames, count - pos);
+            float* target = toFile ? block.data() : new float[kChunkFrames];
+            for (size_t i = 0; i < n; ++i) {
+                double at = (pos + i) / ratio;
+                size_t idx = static_cast<size_t>(at);
+                double frac = at - idx;
+                float a = sample(std::min(idx, last));
+                float b = sample(std::min(idx + 1, last));
+                target[i] = static_cast<float>(a + (b - a) * frac);
+            }
+            if (toFile) {
+                out->write(target, n);
+            } else {
+                converted.push_back(target);
+            }
+        }
+        if (out) out->close();
+    }
+
+    if (toFile) {
+        openFile(file, sampleRate);
+        return;
+    }
+    clear();
+    for (size_t i = 0; i < converted.size(); ++i) {
+        chunks.slot(i).store(converted[i], std::memory_order_release);
+    }
+    length.store(count, std::memory_order_release);
+}
+
+// Buffers whose last owner has gone, waiting for reclaimRetired()
+static std::mutex retireMutex;
+static std::vector<RecordBuffer*> retired;
+
+std::shared_ptr<RecordBuffer> RecordBuffer::create()
+{
+    return std::shared_ptr<RecordBuffer>(new RecordBuffer(), [](RecordBuffer* buffer) {
+        std::lock_guard<std::mutex> lock(retireMutex);
+        retired.push_back(buffer);
+    });
+}
+
+void RecordBuffer::reclaimRetired()
+{
+    std::vector<RecordBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(retireMutex);
+        buffers.swap(retired);
+    }
+    for (RecordBuffer* buffer : buffers) {
+        delete buffer;
+    }
+}
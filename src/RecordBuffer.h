@@ -0,0 +1,210 @@
+#ifndef RECORDBUFFER_H
+#define RECORDBUFFER_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AtomicTable.h"
+#include "PeakCache.h"
+#include "WavWriter.h"
+
+// Recorded samples of one track, stored as a chain of fixed-size chunks.
+// The audio thread appends without allocating: when a chunk fills up it
+// takes the next one from a small ring of spares that a non-real-time
+// thread keeps topped up with refill() while the buffer is recorded into. Readers see every sample below
+// size(); a chunk never moves while it is resident. The table of chunk
+// slots is paged in the same way as the take grows, so a clip that is
+// never recorded into costs next to nothing.
+//
+// The disk thread also keeps a peak cache of the take for drawing. While
+// recording, append() hands it ready-made entries through a lock-free ring,
+// so a live take costs the same to keep up with however long it gets.
+//
+// A take can also be spooled to a WAV file by a disk thread calling
+// stream(), or be an existing WAV file opened with openFile(). The file is
+// memory-mapped: chunks that are on disk are served straight from the
+// mapping, and only a window around the play position (plus the start of
+// the take and the loop start) is locked into RAM at a time, with read-ahead hints for what
+// follows. Everything else is left to the page cache, so takes larger
+// than RAM play back without the audio thread ever waiting on the disk.
+class RecordBuffer {
+public:
+    static const size_t kChunkFrames = 65536;  // power of two
+    static const size_t kMaxChunks = 8192;     // about 3 hours at 48 kHz
+    static const size_t kSpareChunks = 2;
+    static const size_t kReadAheadChunks = 2;  // pinned ahead of playback when on disk
+    static const size_t kWriteFrames = 16384;  // smallest write to the spool file
+
+    // What the track is doing, as seen by the disk thread
+    struct StreamState {
+        bool recording;
+        bool playing;
+        size_t playPosition; // frame within the take
+        bool looping;        // playback jumps back to loopPosition
+        size_t loopPosition; // frame within the take
+    };
+
+    RecordBuffer();
+    ~RecordBuffer();
+
+    RecordBuffer(const RecordBuffer&) = delete;
+    RecordBuffer& operator=(const RecordBuffer&) = delete;
+
+    // Audio thread: append samples. Frames that find no spare chunk, or no
+    // slot for it, are dropped and counted.
+    void append(const float* samples, size_t frames);
+
+    size_t size() const { return length.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    // Sample `i` (below size()), or silence if that part is only on disk
+    float operator[](size_t i) const
+    {
+        const float* chunk = chunks.load(i / kChunkFrames);
+        return chunk ? chunk[i % kChunkFrames] : 0.0f;
+    }
+    // Copy `frames` resident samples starting at `start`, silence elsewhere
+    void read(size_t start, float* out, size_t frames) const;
+
+    // Frames lost because no spare chunk was ready
+    uint64_t droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Allocator thread: make sure spare chunks, and slots for them in the
+    // chunk table, are waiting
+    void refill();
+    // Control thread, once recording into this buffer has stopped: free
+    // the spares
+    void releaseSpares();
+
+    // Disk thread: true if the take has samples that are not in a spool
+    // file yet and no file is open for them
+    bool needsSpool() const;
+    // Disk thread: start spooling the take to `path`, unless a spool file
+    // is already open. Throws std::runtime_error if the file cannot be
+    // created or mapped.
+    void startSpool(const std::string& path, double sampleRate);
+    // Control thread, on an empty buffer: use an existing mono 32-bit float
+    // WAV file as the take. Throws std::runtime_error if the file cannot
+    // be read, has another format or another sample rate.
+    void openFile(const std::string& path, double sampleRate);
+    // Chunks stream() took out of use. The audio thread may still be
+    // reading them until the caller has held instrumentsMutex once; after
+    // that, release() frees the heap chunks and unpins the mapped ones.
+    // The buffers must stay alive until then.
+    struct Evicted {
+        std::vector<float*> chunks;                           // heap chunks
+        std::vector<std::pair<RecordBuffer*, size_t>> mapped; // buffer, chunk index
+
+        bool empty() const { return chunks.empty() && mapped.empty(); }
+        void release();
+    };
+
+    // Disk thread: write finished samples to the spool file and move the
+    // pinned window to follow playback. Chunks that are no longer needed
+    // are added to `evicted`. Throws std::runtime_error on I/O errors.
+    void stream(const StreamState& state, Evicted& evicted);
+    // File backing the take, empty if it only lives in memory
+    std::string spoolPath() const;
+    // spoolPath() without waiting for the disk thread: false, leaving
+    // `out` alone, if it holds the buffer
+    bool tryGetSpoolPath(std::string& out) const;
+    // Bumped whenever spoolPath() changes, so a copy of it only needs
+    // refreshing when this moves on; starts at 1
+    unsigned spoolPathVersion() const { return pathVersion.load(std::memory_order_acquire); }
+    // Waveform summary for drawing, filled in by stream() as the take
+    // grows or is read from disk
+    const PeakCache& peaks() const { return peakCache; }
+
+    // Control thread, while nothing is appending: drop the contents. A
+    // spool file is completed and kept.
+    void clear();
+    // Control thread, while nothing is appending: linearly resample the
+    // take by `ratio` (new rate / old rate), a chunk at a time. A take with
+    // a file is written to `file` at `sampleRate` and then served from it
+    // as with openFile(), so it never has to fit in RAM; the old file is
+    // kept. Throws std::runtime_error on I/O errors.
+    void resample(double ratio, double sampleRate, const std::string& file);
+
+    // Shared ownership with deferred destruction. Dropping the last owner
+    // can happen under instrumentsMutex (deleting a clip), so the buffer
+    // goes on a retire list instead and reclaimRetired() finishes its file
+    // and frees it later.
+    static std::shared_ptr<RecordBuffer> create();
+    // Disk thread: destroy the buffers retired since the last call
+    static void reclaimRetired();
+
+private:
+    float* takeSpare();
+    // Map `fd` for reading, `bytes` long; diskMutex held
+    void mapFile(int fd, size_t bytes);
+    // Reserve `bytes` of address space for a spool file that will grow
+    // into it, with nothing mapped yet; diskMutex held
+    void reserveMapping(size_t bytes);
+    // Map the spool file into the reserved range up to `frames` samples,
+    // so every page of the file that is mapped has been written; diskMutex
+    // held
+    void growMapping(size_t frames);
+    // Chunk `index` inside the mapping
+    float* mappedChunk(size_t index) const;
+    bool isMapped(const float* chunk) const;
+    // Lock `frames` mapped samples into RAM, or at least fault them in
+    void pin(const float* samples, size_t frames);
+    // Undo pin() and let the kernel reclaim the pages
+    void unpin(const float* samples, size_t frames);
+    // Unpin mapped chunk `index` unless stream() has made it resident
+    // again since evicting it
+    void unpinEvicted(size_t index);
+    // Write samples up to `available` to the spool file; diskMutex held
+    void writePending(size_t available);
+    // Audio thread: summarise samples stored at frame `pos` into fine peak
+    // entries for the disk thread
+    void summarise(const float* samples, size_t frames, size_t pos);
+    // Fold the audio thread's entries into peakCache, then summarise
+    // samples up to `available` that have none (all of them unless
+    // `recording`), a bounded amount per call; diskMutex held
+    void updatePeaks(size_t available, bool recording);
+
+    AtomicTable<float> chunks; // kMaxChunks slots, paged in as the take grows
+    std::atomic<size_t> length;
+    std::atomic<uint64_t> dropped;
+
+    // Single producer (refill) / single consumer (append) ring of spares
+    std::atomic<float*> spares[kSpareChunks + 1];
+    std::atomic<size_t> spareHead;  // next slot to fill
+    std::atomic<size_t> spareTail;  // next slot to take
+
+    // Backing file state, only touched by non-real-time threads
+    mutable std::mutex diskMutex;
+    std::unique_ptr<WavWriter> writer;
+    std::string path;
+    std::atomic<unsigned> pathVersion;
+    char* mapping;      // whole file, from byte 0
+    size_t mappingBytes;
+    int spoolFd;        // spool file, open for growMapping()
+    size_t fileMapped;  // bytes of the spool mapping backed by the file
+    size_t dataOffset;  // byte offset of the samples in the file
+    size_t flushed;     // frames available in the file
+    PeakCache peakCache;
+
+    // Single producer (append) / single consumer (stream) ring of fine
+    // peak entries, allocated with the first spares
+    struct PeakEntry {
+        size_t index;
+        PeakCache::Peak peak;
+    };
+    static const size_t kPeakEntries = 1024;
+    std::unique_ptr<PeakEntry[]> peakRing;
+    std::atomic<size_t> peakHead;
+    std::atomic<size_t> peakTail;
+    PeakCache::Peak livePeak; // entry being filled by the audio thread
+    double liveSquares;
+    size_t liveFrames;
+};
+
+#endif // RECORDBUFFER_H
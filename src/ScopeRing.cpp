@@ -0,0 +1,39 @@
+#include "ScopeRing.h"
+#include <algorithm>
+#include <cstring>
+
+const size_t ScopeRing::kCapacity;
+
+ScopeRing::ScopeRing() : data(new float[kCapacity]()), writePos(0), readPos(0) {}
+
+void ScopeRing::write(const float* samples, size_t frames)
+{
+    size_t w = writePos.load(std::memory_order_relaxed);
+    size_t r = readPos.load(std::memory_order_acquire);
+    if (kCapacity - (w - r) < frames) return;
+
+    size_t offset = w & (kCapacity - 1);
+    size_t first = std::min(frames, kCapacity - offset);
+    std::memcpy(data.get() + offset, samples, first * sizeof(float));
+    std::memcpy(data.get(), samples + first, (frames - first) * sizeof(float));
+    writePos.store(w + frames, std::memory_order_release);
+}
+
+size_t ScopeRing::read(float* out, size_t frames)
+{
+    size_t r = readPos.load(std::memory_order_relaxed);
+    size_t w = writePos.load(std::memory_order_acquire);
+    size_t n = std::min(frames, w - r);
+
+    size_t offset = r & (kCapacity - 1);
+    size_t first = std::min(n, kCapacity - offset);
+    std::memcpy(out, data.get() + offset, first * sizeof(float));
+    std::memcpy(out + first, data.get(), (n - first) * sizeof(float));
+    readPos.store(r + n, std::memory_order_release);
+    return n;
+}
+
+void ScopeRing::discard()
+{
+    readPos.store(writePos.load(std::memory_order_acquire), std::memory_order_release);
+}
@@ -0,0 +1,38 @@
+#ifndef SCOPERING_H
+#define SCOPERING_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Single producer / single consumer ring of output samples for scopes and
+// analysers. The audio thread copies each block in with a memcpy and two
+// atomic operations; when the reader falls behind, blocks are dropped
+// instead of waiting for it.
+class ScopeRing {
+public:
+    static const size_t kCapacity = 32768; // power of two
+
+    ScopeRing();
+
+    ScopeRing(const ScopeRing&) = delete;
+    ScopeRing& operator=(const ScopeRing&) = delete;
+
+    // Audio thread: append a block, or drop it if it does not fit
+    void write(const float* samples, size_t frames);
+
+    // Reader: move up to `frames` of the oldest unread samples to `out`
+    // and return how many there were
+    size_t read(float* out, size_t frames);
+    // Reader: throw away everything unread
+    void discard();
+
+private:
+    std::unique_ptr<float[]> data;
+    std::atomic<size_t> writePos; // total samples written
+    std::atomic<size_t> readPos;  // total samples read
+};
+
+#endif // SCOPERING_H
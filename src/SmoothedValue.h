@@ -0,0 +1,58 @@
+#ifndef SMOOTHEDVALUE_H
+#define SMOOTHEDVALUE_H
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+// A parameter that glides to new settings instead of jumping, so faders,
+// mutes and pans don't click. The audio thread advances it once per block:
+// the value moves linearly towards its target by at most one unit per
+// `rampSeconds`, and samples inside the block are interpolated between
+// the values at the block's two ends.
+class SmoothedValue {
+public:
+    SmoothedValue(float initial, float rampSeconds)
+        : from(initial), to(initial), rampSeconds(rampSeconds) {}
+
+    // Start a block of `frames` heading for `target`
+    void advance(float target, size_t frames, double sampleRate)
+    {
+        from = to;
+        float step = static_cast<float>(frames / (rampSeconds * sampleRate));
+        float delta = target - from;
+        if (std::fabs(delta) <= step) {
+            to = target;
+        } else {
+            to = delta > 0.0f ? from + step : from - step;
+        }
+    }
+
+    // Values at the start and end of the current block
+    float start() const { return from; }
+    float end() const { return to; }
+    bool ramping() const { return from != to; }
+
+    // Multiply a block by the value, ramping if it is moving
+    void apply(float* samples, size_t frames) const
+    {
+        if (!ramping()) {
+            for (size_t i = 0; i < frames; ++i) {
+                samples[i] *= to;
+            }
+            return;
+        }
+        float step = (to - from) / frames;
+        for (size_t i = 0; i < frames; ++i) {
+            samples[i] *= from + step * (i + 1);
+        }
+    }
+
+private:
+    float from;
+    float to;
+    float rampSeconds;
+};
+
+#endif // SMOOTHEDVALUE_H
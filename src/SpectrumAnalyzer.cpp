@@ -0,0 +1,78 @@
+#include "SpectrumAnalyzer.h"
+#include <algorithm>
+#include <cmath>
+
+const size_t SpectrumAnalyzer::kSize;
+
+// Weight of the newest spectrum in the running average
+static const float kAveraging = 0.3f;
+static const double kLowestFrequency = 20.0;
+
+SpectrumAnalyzer::SpectrumAnalyzer(size_t bands)
+    : window(kSize), bins(kSize), power(kSize / 2 + 1, 0.0f), bandLevels(bands, -120.0f)
+{
+    const double pi = 3.14159265358979323846;
+    for (size_t i = 0; i < kSize; ++i) {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * pi * i / kSize));
+    }
+}
+
+double SpectrumAnalyzer::bandEdge(size_t band, size_t bands, double sampleRate)
+{
+    double nyquist = sampleRate / 2.0;
+    return kLowestFrequency * std::pow(nyquist / kLowestFrequency, static_cast<double>(band) / bands);
+}
+
+// In-place iterative radix-2 FFT of `bins`
+void SpectrumAnalyzer::fft()
+{
+    const double pi = 3.14159265358979323846;
+    for (size_t i = 1, j = 0; i < kSize; ++i) {
+        size_t bit = kSize >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(bins[i], bins[j]);
+    }
+    for (size_t len = 2; len <= kSize; len <<= 1) {
+        double angle = -2.0 * pi / len;
+        std::complex<float> step(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+        for (size_t i = 0; i < kSize; i += len) {
+            std::complex<float> w(1.0f, 0.0f);
+            for (size_t k = 0; k < len / 2; ++k) {
+                std::complex<float> a = bins[i + k];
+                std::complex<float> b = bins[i + k + len / 2] * w;
+                bins[i + k] = a + b;
+                bins[i + k + len / 2] = a - b;
+                w *= step;
+            }
+        }
+    }
+}
+
+void SpectrumAnalyzer::analyze(const float* samples, double sampleRate)
+{
+    for (size_t i = 0; i < kSize; ++i) {
+        bins[i] = std::complex<float>(samples[i] * window[i], 0.0f);
+    }
+    fft();
+
+    // A full-scale sine peaks at kSize / 4 through the Hann window
+    const float norm = 4.0f / kSize;
+    for (size_t i = 0; i < power.size(); ++i) {
+        float magnitude = std::abs(bins[i]) * norm;
+        power[i] += kAveraging * (magnitude * magnitude - power[i]);
+    }
+
+    // Loudest bin in each band; bands narrower than a bin use the bin
+    // their lower edge falls in
+    const double binHz = sampleRate / kSize;
+    size_t bands = bandLevels.size();
+    for (size_t b = 0; b < bands; ++b) {
+        size_t first = static_cast<size_t>(bandEdge(b, bands, sampleRate) / binHz + 0.5);
+        size_t last = static_cast<size_t>(bandEdge(b + 1, bands, sampleRate) / binHz + 0.5);
+        first = std::min(first, power.size() - 1);
+        last = std::min(std::max(last, first + 1), power.size());
+        float peak = *std::max_element(power.begin() + first, power.begin() + last);
+        bandLevels[b] = 10.0f * std::log10(std::max(peak, 1e-12f));
+    }
+}
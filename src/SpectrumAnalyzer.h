@@ -0,0 +1,37 @@
+#ifndef SPECTRUMANALYZER_H
+#define SPECTRUMANALYZER_H
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+// Magnitude spectrum for display: Hann-windowed FFT of the latest
+// samples, averaged over calls and folded into bands spaced evenly on a
+// log frequency axis from 20 Hz to Nyquist. Meant for the UI thread.
+class SpectrumAnalyzer {
+public:
+    static const size_t kSize = 2048; // FFT length, power of two
+
+    explicit SpectrumAnalyzer(size_t bands = 128);
+
+    // Analyse samples[0, kSize)
+    void analyze(const float* samples, double sampleRate);
+
+    // Averaged band levels in dB relative to a full-scale sine, lowest
+    // band first
+    const std::vector<float>& levels() const { return bandLevels; }
+    // Lower edge of `band` in Hz
+    static double bandEdge(size_t band, size_t bands, double sampleRate);
+
+private:
+    void fft();
+
+    std::vector<float> window;
+    std::vector<std::complex<float>> bins;
+    std::vector<float> power;      // averaged power per FFT bin
+    std::vector<float> bandLevels;
+};
+
+#endif // SPECTRUMANALYZER_H
@@ -0,0 +1,173 @@
+#include "TimelineCache.h"
+#include <imgui.h>
+#include <algorithm>
+
+TimelineCache::TimelineCache()
+{
+    gridImage.texture = 0;
+    gridImage.key = Key();
+    gridImage.used = false;
+}
+
+TimelineCache::~TimelineCache()
+{
+    release();
+}
+
+void TimelineCache::release()
+{
+    if (gridImage.texture) glDeleteTextures(1, &gridImage.texture);
+    gridImage.texture = 0;
+    for (auto &c : clips) {
+        glDeleteTextures(1, &c.second.texture);
+    }
+    clips.clear();
+}
+
+void TimelineCache::collect()
+{
+    for (auto it = clips.begin(); it != clips.end();) {
+        if (!it->second.used) {
+            glDeleteTextures(1, &it->second.texture);
+            it = clips.erase(it);
+        } else {
+            it->second.used = false;
+            ++it;
+        }
+    }
+}
+
+void TimelineCache::upload(Image& image, int width, int height)
+{
+    if (!image.texture) {
+        glGenTextures(1, &image.texture);
+        glBindTexture(GL_TEXTURE_2D, image.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, image.texture);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+void TimelineCache::fillColumn(int x, int y0, int y1, uint32_t color, int width, int height)
+{
+    y0 = std::max(0, y0);
+    y1 = std::min(height - 1, y1);
+    for (int y = y0; y <= y1; ++y) {
+        pixels[y * width + x] = color;
+    }
+}
+
+GLuint TimelineCache::grid(int width, int height, int tracks, int divisions)
+{
+    if (width <= 0 || height <= 0 || tracks <= 0) return 0;
+    Key key = Key();
+    key.width = width;
+    key.height = height;
+    key.content = static_cast<size_t>(tracks);
+    key.frames = static_cast<size_t>(divisions);
+    if (gridImage.texture && gridImage.key == key) return gridImage.texture;
+
+    pixels.assign(static_cast<size_t>(width) * height, IM_COL32(50,50,50,200));
+    for (int i = 0; i <= divisions && divisions > 0; ++i) {
+        int x = std::min(width - 1, (i * width) / divisions);
+        fillColumn(x, 0, height - 1, IM_COL32(80,80,80,255), width, height);
+    }
+    // Gaps between the track rows
+    int trackHeight = height / tracks;
+    for (int t = 1; t < tracks; ++t) {
+        std::fill(pixels.begin() + (t * trackHeight - 1) * width, pixels.begin() + t * trackHeight * width,
+                  IM_COL32(30,30,30,255));
+    }
+    upload(gridImage, width, height);
+    gridImage.key = key;
+    return gridImage.texture;
+}
+
+GLuint TimelineCache::clip(const Clip& clip, int width, int height, double sampleRate)
+{
+    size_t frames = clip.frames();
+    if (width <= 0 || height <= 0 || frames == 0) return 0;
+
+    Key key = Key();
+    key.width = width;
+    key.height = height;
+    key.content = clip.notes ? clip.notes->getEvents().size() : clip.take->peaks().frames();
+    key.frames = frames;
+    key.gain = clip.gain;
+    key.tempo = clip.notes ? clip.notes->getTempo() : 1.0;
+
+    const void* take = clip.notes ? static_cast<const void*>(clip.notes.get())
+                                  : static_cast<const void*>(clip.take.get());
+    auto it = clips.find(take);
+    if (it == clips.end()) {
+        Image image;
+        image.texture = 0;
+        image.key = Key();
+        image.used = false;
+        it = clips.insert(std::make_pair(take, image)).first;
+    }
+    Image& image = it->second;
+    image.used = true;
+    if (image.texture && image.key == key) return image.texture;
+
+    pixels.assign(static_cast<size_t>(width) * height, 0);
+    if (clip.notes) {
+        drawNotes(clip, frames, width, height, sampleRate);
+    } else {
+        drawPeaks(clip, frames, width, height);
+    }
+    upload(image, width, height);
+    image.key = key;
+    return image.texture;
+}
+
+void TimelineCache::drawPeaks(const Clip& clip, size_t frames, int width, int height)
+{
+    // Min/max per pixel from the peak cache, RMS on top
+    const PeakCache& peaks = clip.take->peaks();
+    float mid = height * 0.5f;
+    float scale = clip.gain * (height / 2.0f);
+    double framesPerPixel = static_cast<double>(frames) / width;
+    for (int x = 0; x < width; ++x) {
+        PeakCache::Peak p;
+        size_t from = static_cast<size_t>(x * framesPerPixel);
+        size_t to = std::max(from + 1, static_cast<size_t>((x + 1) * framesPerPixel));
+        if (!peaks.range(from, to, p)) break;
+        fillColumn(x, static_cast<int>(mid - p.max * scale), static_cast<int>(mid - p.min * scale),
+                   IM_COL32(255,255,255,100), width, height);
+        fillColumn(x, static_cast<int>(mid - p.rms * scale), static_cast<int>(mid + p.rms * scale),
+                   IM_COL32(255,255,255,160), width, height);
+    }
+}
+
+void TimelineCache::drawNotes(const Clip& clip, size_t frames, int width, int height, double sampleRate)
+{
+    // Piano roll: a line per note, two octaves either side of C4. Event
+    // times are at tempo 1, the clip is drawn at its tempo.
+    const std::vector<NoteTake::Event>& events = clip.notes->getEvents();
+    double recorded = clip.notes->getTempo() * frames / sampleRate;
+    if (recorded <= 0.0) return;
+    double scale = width / recorded;
+    for (size_t e = 0; e < events.size(); ++e) {
+        if (!events[e].on) continue;
+        double off = recorded;
+        for (size_t f = e + 1; f < events.size(); ++f) {
+            if (!events[f].on && events[f].note == events[e].note) {
+                off = events[f].time;
+                break;
+            }
+        }
+        float pitch = std::min(1.0f, std::max(0.0f, (events[e].note - 36) / 48.0f));
+        int y = static_cast<int>(height - 3 - pitch * (height - 6));
+        int x0 = static_cast<int>(events[e].time * scale);
+        int x1 = std::max(x0 + 1, static_cast<int>(off * scale));
+        for (int x = std::max(0, x0); x < std::min(width, x1); ++x) {
+            fillColumn(x, y - 1, y, IM_COL32(255,255,255,200), width, height);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef TIMELINECACHE_H
+#define TIMELINECACHE_H
+
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "Clip.h"
+
+// Pre-rendered timeline images kept as OpenGL textures: the grid with the
+// track rows, and one waveform (or piano roll) per clip. An image is only
+// redrawn when what it shows changes (new samples or notes, gain, tempo,
+// zoom or size), so a frame costs a textured quad per clip instead of a
+// line per pixel. Needs the GL context current in every call.
+class TimelineCache {
+public:
+    TimelineCache();
+    ~TimelineCache();
+
+    TimelineCache(const TimelineCache&) = delete;
+    TimelineCache& operator=(const TimelineCache&) = delete;
+
+    // Track rows and a vertical line per division
+    GLuint grid(int width, int height, int tracks, int divisions);
+    // The clip's contents at `width` x `height` pixels, on a transparent
+    // background; 0 if there is nothing to draw
+    GLuint clip(const Clip& clip, int width, int height, double sampleRate);
+
+    // Free the textures of clips not drawn since the last call; once per
+    // frame
+    void collect();
+    // Free everything, before the GL context goes away
+    void release();
+
+private:
+    // What an image was drawn from; redrawn when any of it changes
+    struct Key {
+        int width;
+        int height;
+        size_t content; // summarised frames, or note events
+        size_t frames;
+        float gain;
+        double tempo;
+        bool operator==(const Key& o) const
+        {
+            return width == o.width && height == o.height && content == o.content &&
+                   frames == o.frames && gain == o.gain && tempo == o.tempo;
+        }
+    };
+    struct Image {
+        GLuint texture;
+        Key key;
+        bool used;
+    };
+
+    void drawPeaks(const Clip& clip, size_t frames, int width, int height);
+    void drawNotes(const Clip& clip, size_t frames, int width, int height, double sampleRate);
+    // Upload `pixels` into the image's texture, creating it if needed
+    void upload(Image& image, int width, int height);
+    void fillColumn(int x, int y0, int y1, uint32_t color, int width, int height);
+
+    Image gridImage;
+    std::map<const void*, Image> clips; // by take
+    std::vector<uint32_t> pixels;       // RGBA, row-major
+};
+
+#endif // TIMELINECACHE_H
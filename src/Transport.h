@@ -0,0 +1,28 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Tempo and loop points shared by every track. Owned by the engine and set
+// from the control thread; the audio thread reads it once per block.
+struct Transport {
+    std::atomic<double> bpm;
+    std::atomic<bool> looping;
+    std::atomic<double> loopStart;     // beats
+    std::atomic<double> loopEnd;       // beats, exclusive
+    std::atomic<float> crossfadeSeconds; // blend at the loop seam
+
+    Transport()
+        : bpm(120.0), looping(false), loopStart(0.0), loopEnd(16.0), crossfadeSeconds(0.005f) {}
+
+    // Timeline frame of a position in beats
+    size_t beatToFrame(double beats, double sampleRate) const
+    {
+        return static_cast<size_t>(beats * 60.0 / bpm.load(std::memory_order_relaxed) * sampleRate + 0.5);
+    }
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,53 @@
+#ifndef UISNAPSHOT_H
+#define UISNAPSHOT_H
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Clip.h"
+
+// Read-only copy of what the editor shows, taken by AudioEngine::sync()
+// once per UI frame so drawing never holds instrumentsMutex. Clips share
+// their takes with the engine; only the parts of a take that are safe to
+// read without the lock are used: size, note events of a finished take,
+// and peaks (a cleared PeakCache keeps its storage, and a
+// take is only destroyed once the snapshot lets go of it).
+struct ClipSnapshot {
+    Clip clip;
+    size_t frames;
+    bool recording; // the take being recorded into
+    // Copy of the take's spool path, carried over from the last snapshot
+    // until RecordBuffer::spoolPathVersion() moves on; version 0 until read
+    std::string spoolPath;
+    unsigned spoolPathVersion;
+
+    ClipSnapshot(const Clip& clip, size_t frames, bool recording)
+        : clip(clip), frames(frames), recording(recording), spoolPathVersion(0) {}
+};
+
+struct TrackSnapshot {
+    std::string name;
+    std::string waveform;
+    float volume;
+    float pan;
+    float spread;
+    bool mute;
+    bool softClip;
+    float sendLevel;
+    bool isRecording;
+    bool isPlaying;
+    bool recordNotes;
+    uint64_t droppedFrames; // of the take being recorded
+    double length;          // seconds
+    std::vector<ClipSnapshot> clips;
+};
+
+struct UiSnapshot {
+    double sampleRate;
+    std::vector<TrackSnapshot> tracks;
+};
+
+#endif // UISNAPSHOT_H
@@ -0,0 +1,18 @@
+#ifndef VOICE_H
+#define VOICE_H
+
+#pragma once
+
+#include "Oscillator.h"
+
+// Wave table size used for every voice
+static const unsigned kVoiceTableSize = 200;
+
+// Simple container for a single playing voice
+struct Voice {
+    Oscillator osc;
+    int note;
+    Voice(unsigned tableSize, double sampleRate) : osc(tableSize, sampleRate), note(0) {}
+};
+
+#endif // VOICE_H
@@ -0,0 +1,99 @@
+#include "WavWriter.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+const uint32_t WavWriter::kDataOffset;
+
+// Little-endian field writers for the RIFF header
+static void put16(std::ofstream& out, uint16_t v)
+{
+    char b[2] = { static_cast<char>(v & 0xff), static_cast<char>(v >> 8) };
+    out.write(b, 2);
+}
+
+static void put32(std::ofstream& out, uint32_t v)
+{
+    char b[4] = { static_cast<char>(v & 0xff), static_cast<char>((v >> 8) & 0xff),
+                  static_cast<char>((v >> 16) & 0xff), static_cast<char>(v >> 24) };
+    out.write(b, 4);
+}
+
+WavWriter::WavWriter(const std::string& filename, double sampleRate, unsigned channels, Format format)
+    : filename(filename), sampleRate(static_cast<uint32_t>(sampleRate)), channels(channels),
+      format(format), framesWritten(0)
+{
+    fileStream.open(filename, std::ios::binary | std::ios::trunc);
+    if (!fileStream.is_open()) {
+        throw std::runtime_error("Could not open file for writing: " + filename);
+    }
+    writeHeader();
+}
+
+WavWriter::~WavWriter()
+{
+    close();
+}
+
+void WavWriter::writeHeader()
+{
+    uint16_t bytesPerSample = format == Float32 ? 4 : 2;
+    uint64_t dataBytes = framesWritten * channels * bytesPerSample;
+    // RIFF sizes are 32-bit; clamp rather than wrap for very long files
+    uint32_t dataSize = static_cast<uint32_t>(std::min<uint64_t>(dataBytes, 0xffffffffu - 36));
+
+    fileStream.write("RIFF", 4);
+    put32(fileStream, 36 + dataSize);
+    fileStream.write("WAVE", 4);
+    fileStream.write("fmt ", 4);
+    put32(fileStream, 16);
+    put16(fileStream, format == Float32 ? 3 : 1); // IEEE float or PCM
+    put16(fileStream, static_cast<uint16_t>(channels));
+    put32(fileStream, sampleRate);
+    put32(fileStream, sampleRate * channels * bytesPerSample);
+    put16(fileStream, static_cast<uint16_t>(channels * bytesPerSample));
+    put16(fileStream, bytesPerSample * 8);
+    fileStream.write("data", 4);
+    put32(fileStream, dataSize);
+}
+
+void WavWriter::write(const float* samples, size_t frames)
+{
+    size_t count = frames * channels;
+    if (format == Float32) {
+        // WAV is little-endian, as are all platforms we build for
+        fileStream.write(reinterpret_cast<const char*>(samples), count * sizeof(float));
+    } else {
+        std::vector<int16_t> pcm(count);
+        for (size_t i = 0; i < count; ++i) {
+            float s = std::max(-1.0f, std::min(1.0f, samples[i]));
+            pcm[i] = static_cast<int16_t>(s * 32767.0f);
+        }
+        fileStream.write(reinterpret_cast<const char*>(pcm.data()), count * sizeof(int16_t));
+    }
+    if (!fileStream) {
+        throw std::runtime_error("Write failed: " + filename);
+    }
+    framesWritten += frames;
+}
+
+void WavWriter::flush()
+{
+    fileStream.flush();
+    if (!fileStream) {
+        throw std::runtime_error("Write failed: " + filename);
+    }
+}
+
+void WavWriter::close()
+{
+    if (!fileStream.is_open()) return;
+    fileStream.seekp(0);
+    writeHeader();
+    fileStream.close();
+}
+
+uint64_t WavWriter::getFramesWritten() const
+{
+    return framesWritten;
+}
@@ -0,0 +1,48 @@
+#ifndef WAVWRITER_H
+#define WAVWRITER_H
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Streams interleaved float samples into a RIFF/WAVE file. The header is
+// written up front and its sizes patched in close().
+class WavWriter {
+public:
+    enum Format { Float32, Int16 };
+
+    // Byte offset of the sample data; the header has a fixed size
+    static const uint32_t kDataOffset = 44;
+
+    // Throws std::runtime_error if the file cannot be created
+    WavWriter(const std::string& filename, double sampleRate, unsigned channels,
+              Format format = Float32);
+    ~WavWriter();
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    // Append `frames` interleaved frames
+    void write(const float* samples, size_t frames);
+    // Push buffered samples to the OS so the file can be read back while
+    // it is still being written
+    void flush();
+    // Finish the header; called by the destructor if needed
+    void close();
+
+    uint64_t getFramesWritten() const;
+
+private:
+    void writeHeader();
+
+    std::ofstream fileStream;
+    std::string filename;
+    uint32_t sampleRate;
+    unsigned channels;
+    Format format;
+    uint64_t framesWritten;
+};
+
+#endif // WAVWRITER_H
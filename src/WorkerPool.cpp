@@ -0,0 +1,128 @@
+#include "WorkerPool.h"
+#include "RealtimeGuard.h"
+#include <chrono>
+
+// How long a worker polls for the next batch before going to sleep. Kept
+// short: a real-time worker that spins can starve lower priority threads.
+static const std::chrono::microseconds kSpinTime(50);
+
+// How long run() polls for the rest of a batch before blocking. A worker
+// that shares the caller's core cannot finish while the caller spins.
+static const std::chrono::microseconds kFinishSpinTime(20);
+
+WorkerPool::WorkerPool(unsigned threadCount, std::function<void(unsigned)> onStart)
+    : claim(0), batch(0), remaining(0), batchSize(0), job(nullptr), context(nullptr),
+      stopping(false), sleeping(0),
+      // Spinning only pays off when every worker can have a core of its own
+      spinWait(std::thread::hardware_concurrency() > threadCount), waiting(false)
+{
+    for (unsigned i = 0; i < threadCount; ++i) {
+        threads.emplace_back(&WorkerPool::workerLoop, this, i, onStart);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wake.notify_all();
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+unsigned WorkerPool::size() const
+{
+    return static_cast<unsigned>(threads.size());
+}
+
+void WorkerPool::run(Job j, void* ctx, size_t count)
+{
+    if (count == 0) return;
+
+    uint32_t next = batch.load(std::memory_order_relaxed) + 1;
+    job.store(j, std::memory_order_relaxed);
+    context.store(ctx, std::memory_order_relaxed);
+    batchSize.store(count, std::memory_order_relaxed);
+    remaining.store(count, std::memory_order_relaxed);
+    claim.store(static_cast<uint64_t>(next) << 32, std::memory_order_release);
+    batch.store(next, std::memory_order_release);
+
+    // Taking the mutex orders the notify after any worker that has checked
+    // the batch number but not yet started waiting
+    if (sleeping.load() > 0) {
+        ScopedRealtimeAllowance allowed;
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wake.notify_all();
+    }
+
+    drain(next);
+    std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + kFinishSpinTime;
+    while (remaining.load(std::memory_order_acquire) > 0 && std::chrono::steady_clock::now() < until) {
+        std::this_thread::yield();
+    }
+    if (remaining.load(std::memory_order_acquire) > 0) {
+        ScopedRealtimeAllowance allowed;
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        waiting.store(true);
+        finished.wait(lock, [this]{ return remaining.load() == 0; });
+        waiting.store(false);
+    }
+}
+
+void WorkerPool::drain(uint32_t b)
+{
+    uint64_t current = claim.load(std::memory_order_acquire);
+    for (;;) {
+        if (static_cast<uint32_t>(current >> 32) != b) return;
+        size_t index = static_cast<size_t>(current & 0xffffffffu);
+        if (index >= batchSize.load(std::memory_order_acquire)) return;
+        if (!claim.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel)) {
+            continue;
+        }
+        job.load(std::memory_order_acquire)(context.load(std::memory_order_acquire), index);
+        // Sequentially consistent with `waiting`, so either run() sees the
+        // count reach zero or the last item sees run() waiting
+        if (remaining.fetch_sub(1) == 1 && waiting.load()) {
+            ScopedRealtimeAllowance allowed;
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            finished.notify_one();
+        }
+        current = claim.load(std::memory_order_acquire);
+    }
+}
+
+void WorkerPool::workerLoop(unsigned index, std::function<void(unsigned)> onStart)
+{
+    if (onStart) onStart(index);
+
+    uint32_t seen = batch.load(std::memory_order_acquire);
+    while (!stopping.load(std::memory_order_acquire)) {
+        uint32_t current = batch.load(std::memory_order_acquire);
+        if (spinWait && current == seen) {
+            std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + kSpinTime;
+            while (current == seen && std::chrono::steady_clock::now() < until) {
+                std::this_thread::yield();
+                current = batch.load(std::memory_order_acquire);
+            }
+        }
+
+        if (current == seen) {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            sleeping.fetch_add(1);
+            wake.wait_for(lock, std::chrono::milliseconds(2), [&]{
+                return stopping.load() || batch.load() != seen;
+            });
+            sleeping.fetch_sub(1);
+            continue;
+        }
+
+        seen = current;
+        ScopedRealtimeSection realtime;
+        drain(current);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fork/join pool used by the audio graph to run independent nodes in
+// parallel. The calling thread always takes part in the work, so a batch
+// completes even if every worker is asleep or preempted.
+class WorkerPool {
+public:
+    typedef void (*Job)(void* context, size_t index);
+
+    // `onStart` runs first on every worker thread with its index, e.g. to
+    // set scheduling priority and CPU affinity
+    explicit WorkerPool(unsigned threadCount,
+                        std::function<void(unsigned)> onStart = std::function<void(unsigned)>());
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Run job(context, i) for every i in [0, count) and return once all of
+    // them have finished. Only one thread may call run() at a time.
+    void run(Job job, void* context, size_t count);
+
+    unsigned size() const;
+
+private:
+    void workerLoop(unsigned index, std::function<void(unsigned)> onStart);
+    // Claim and execute items of the given batch until none are left
+    void drain(uint32_t batch);
+
+    std::vector<std::thread> threads;
+
+    // High 32 bits: batch number, low 32 bits: next unclaimed index
+    std::atomic<uint64_t> claim;
+    std::atomic<uint32_t> batch;
+    std::atomic<size_t> remaining;
+    std::atomic<size_t> batchSize;
+    std::atomic<Job> job;
+    std::atomic<void*> context;
+
+    std::atomic<bool> stopping;
+    std::atomic<unsigned> sleeping;
+    bool spinWait;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    // Set while run() sleeps on `finished` for the rest of a batch
+    std::atomic<bool> waiting;
+    std::condition_variable finished;
+};
+
+#endif // WORKERPOOL_H
@@ -0,0 +1,192 @@
+// Synth engine without a window: plays or renders note lists and MIDI files
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include "AudioEngine.h"
+#include "MidiFile.h"
+#include "NoteSequence.h"
+#include "Options.h"
+
+// Set from the signal handler to stop live playback early
+static std::atomic<bool> interrupted(false);
+
+static void onSignal(int)
+{
+    interrupted = true;
+}
+
+static bool isWaveform(const std::string& name)
+{
+    return name == "sine" || name == "square" || name == "sawtooth" ||
+           name == "triangle" || name == "noise";
+}
+
+// Render one short note into a fast feedback delay and time the long tail,
+// which decays through the subnormal range. Returns wall seconds.
+static double timeDenormalTail(AudioSettings settings, bool flush, bool dcInjection,
+                               double seconds)
+{
+    settings.flushDenormals = flush;
+    settings.dcInjection = dcInjection;
+    settings.workerThreads = 0;
+
+    AudioEngine engine;
+    engine.configure(settings);
+    engine.addInstrument("Bench");
+    engine.instruments.front().sendLevel = 1.0f;
+    engine.delaySeconds = 0.001f;
+    engine.delayFeedback = 0.9f;
+    std::vector<NoteEvent> events;
+    events.push_back(NoteEvent(0.0, 0, 69, true));
+    events.push_back(NoteEvent(0.05, 0, 69, false));
+    engine.setSequence(events);
+
+    unsigned long frames = settings.framesPerBuffer;
+    std::vector<float> out(frames * 2);
+    uint64_t total = static_cast<uint64_t>(seconds * engine.getSampleRate());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint64_t done = 0; done < total; done += frames) {
+        engine.render(out.data(), frames);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int benchDenormals(const Options& options)
+{
+    const double seconds = 20.0;
+    double plain = timeDenormalTail(options.audio, false, false, seconds);
+    double flushed = timeDenormalTail(options.audio, true, false, seconds);
+    double injected = timeDenormalTail(options.audio, false, true, seconds);
+    std::cout << "Rendering " << seconds << " s of feedback tail:\n"
+              << "  unprotected   " << plain << " s\n"
+              << "  FTZ/DAZ       " << flushed << " s (" << plain / std::max(flushed, 1e-9) << "x)\n"
+              << "  DC injection  " << injected << " s (" << plain / std::max(injected, 1e-9) << "x)"
+              << std::endl;
+    return 0;
+}
+
+static bool tracksPlaying(AudioEngine& engine)
+{
+    std::lock_guard<std::mutex> lock(engine.instrumentsMutex);
+    for (auto &inst : engine.instruments) {
+        if (inst.isPlaying) return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::string error;
+    if (!parseOptions(argc, argv, options, error, true)) {
+        std::cerr << error << std::endl;
+        printUsage(argv[0], true);
+        return 1;
+    }
+    if (options.showHelp) {
+        printUsage(argv[0], true);
+        return 0;
+    }
+    if (options.benchDenormals) {
+        return benchDenormals(options);
+    }
+    if (options.notesFile.empty() && options.midiFile.empty() && options.trackFiles.empty()) {
+        std::cerr << "Nothing to play: give --notes, --midi or --track" << std::endl;
+        printUsage(argv[0], true);
+        return 1;
+    }
+    if (!isWaveform(options.waveform)) {
+        std::cerr << "Unknown waveform " << options.waveform << std::endl;
+        return 1;
+    }
+
+    std::vector<NoteEvent> events;
+    try {
+        if (!options.notesFile.empty()) {
+            events = loadNoteList(options.notesFile);
+        }
+        if (!options.midiFile.empty()) {
+            std::vector<NoteEvent> midi = loadMidiFile(options.midiFile);
+            events.insert(events.end(), midi.begin(), midi.end());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    int instrumentCount = 1;
+    double length = 0.0;
+    for (const NoteEvent& e : events) {
+        instrumentCount = std::max(instrumentCount, e.instrument + 1);
+        length = std::max(length, e.time);
+    }
+
+    AudioEngine engine;
+    engine.configure(options.audio);
+    for (int i = 0; i < instrumentCount; ++i) {
+        engine.addInstrument("Instrument " + std::to_string(i + 1));
+    }
+    {
+        std::lock_guard<std::mutex> lock(engine.instrumentsMutex);
+        for (auto &inst : engine.instruments) inst.waveform = options.waveform;
+    }
+    try {
+        for (const std::string& file : options.trackFiles) {
+            engine.addTrack(file.substr(file.find_last_of('/') + 1), file);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    engine.setSequence(events);
+
+    if (!options.renderFile.empty()) {
+        try {
+            OfflineRenderResult result = engine.renderOffline(options.renderFile, options.tailSeconds);
+            double seconds = result.frames / engine.getSampleRate();
+            std::cout << "Rendered " << seconds << " s to " << options.renderFile << " in "
+                      << result.wallSeconds << " s (" << seconds / std::max(result.wallSeconds, 1e-9)
+                      << "x real time)" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    } else {
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+
+        std::cout << "Playing " << events.size() / 2 << " notes (" << length << " s) on "
+                  << instrumentCount << " instrument(s) and " << options.trackFiles.size()
+                  << " track(s)" << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(engine.instrumentsMutex);
+            for (auto &inst : engine.instruments) {
+                inst.playIndex = 0;
+                inst.isPlaying = !inst.clips.empty();
+            }
+        }
+        engine.start(options.audio);
+
+        while (!interrupted && (!engine.isSequenceFinished() || tracksPlaying(engine))) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        std::chrono::steady_clock::time_point tailEnd = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(static_cast<long>(options.tailSeconds * 1000));
+        while (!interrupted && std::chrono::steady_clock::now() < tailEnd) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        engine.stop();
+    }
+
+    if (!options.statsFile.empty()) {
+        std::ofstream file(options.statsFile);
+        engine.loadMeter.writeJson(file);
+    }
+    return 0;
+}
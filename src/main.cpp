@@ -1,12 +1,15 @@
 #include <iostream>
+#include <fstream>
 #include <cmath>
-#include <portaudio.h>
 #include <thread>
 #include <atomic>
 #include <mutex>
 #include <vector>
+#include <deque>
 #include <string>
 #include <algorithm>
+#include <memory>
+#include <chrono>
 
 // ImGui includes
 #include <imgui.h>
@@ -16,152 +19,126 @@
 #include <GLFW/glfw3.h>
 
 #include "Keyboard.h"
+#include "AudioEngine.h"
+#include "Options.h"
+#include "TimelineCache.h"
+#include "SpectrumAnalyzer.h"
 
-#define SAMPLE_RATE 48000
-#define FRAMES_PER_BUFFER 1024
-#define TABLE_SIZE 200
-
-// Simple instrument/track container
-struct Instrument {
-    std::string name;
-    std::string waveform;
-    std::vector<Voice> voices;
-    std::vector<float> recorded;
-    size_t playIndex;
-    bool isRecording;
-    bool isPlaying;
-    float offsetSeconds; // start position for playback
-    float volume;        // per-track volume
-    bool mute;           // track mute state
-
-    Instrument(const std::string& n)
-        : name(n), waveform("sine"), playIndex(0),
-          isRecording(false), isPlaying(false), offsetSeconds(0.0f),
-          volume(1.0f), mute(false) {}
-};
-
-// All instruments/tracks
-std::vector<Instrument> instruments;
+// The synth engine: instruments, processing graph and output stream
+AudioEngine engine;
 int currentInstrument = 0; // index of instrument controlled by keyboard
-
-// Mutex protecting instruments and their data
-std::mutex instrumentsMutex;
-
-// Flag to control audio thread
-std::atomic<bool> audioRunning(true);
+int selectedTrack = -1;    // clip picked on the timeline, -1 for none
+int selectedClip = -1;
 
 // Flag to see if key is pressed
 std::atomic<bool> keyPressed(false);
 
-// Master volume
-std::atomic<float> volume(1.0);
-
-static int patestCallback( const void *inputBuffer, void *outputBuffer,
-                           unsigned long framesPerBuffer,
-                           const PaStreamCallbackTimeInfo* timeInfo,
-                           PaStreamCallbackFlags statusFlags,
-                           void *userData )
-{
-    float *out = (float*) outputBuffer;
-    unsigned long i;
-
-    (void) timeInfo; /* Prevent unused variable warnings. */
-    (void) statusFlags;
-    (void) inputBuffer;
-
-    // Get the current volume value
-    float vol = volume.load();
+// Longest the UI sleeps without input before redrawing
+static const double kIdleRedrawSeconds = 0.25;
 
-    for( i=0; i<framesPerBuffer; i++ )
-    {
-        float value = 0.0f;
-        {
-            std::lock_guard<std::mutex> lock(instrumentsMutex);
-            for (auto &inst : instruments) {
-                // Sum live voices for this instrument
-                float instValue = 0.0f;
-                for (auto &v : inst.voices) {
-                    instValue += static_cast<float>(v.osc.getWaveformValue());
-                }
+// Range of the level meters
+static const float kMeterFloorDb = -60.0f;
 
-                // Record raw waveform before applying volume/mute
-                if (inst.isRecording) {
-                    inst.recorded.push_back(instValue);
-                }
-
-                float instGain = inst.mute ? 0.0f : inst.volume;
-                value += instValue * instGain;
-
-                // Playback of recorded track
-                if (inst.isPlaying) {
-                    size_t offsetSamples = static_cast<size_t>(inst.offsetSeconds * SAMPLE_RATE);
-                    size_t idx = inst.playIndex++;
-                    if (idx >= offsetSamples && (idx - offsetSamples) < inst.recorded.size()) {
-                        value += inst.recorded[idx - offsetSamples] * instGain;
-                    }
-                    if (idx >= offsetSamples + inst.recorded.size()) {
-                        inst.isPlaying = false;
-                        inst.playIndex = 0;
-                    }
-                }
-            }
-        }
+static float meterFraction(float level)
+{
+    float db = level > 0.0f ? 20.0f * std::log10(level) : kMeterFloorDb;
+    return std::max(0.0f, std::min(1.0f, (db - kMeterFloorDb) / -kMeterFloorDb));
+}
 
-        value *= vol;
-        *out++ = value;  /* left */
-        *out++ = value;  /* right */
+// Draw `meter` as a bar: RMS over peak, a line at the held peak and a clip
+// light that clears when clicked. Returns true while there is signal, so
+// the caller keeps redrawing until the meter has fallen back.
+static bool drawMeter(const char* id, LevelMeter& meter)
+{
+    LevelMeter::Reading r = meter.read();
+    const float height = 12.0f, clipWidth = 12.0f;
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    float width = std::max(20.0f, ImGui::GetContentRegionAvail().x - 80.0f) - clipWidth - 4.0f;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+    drawList->AddRectFilled(pos, ImVec2(pos.x + width, pos.y + height), IM_COL32(30,30,30,255));
+    drawList->AddRectFilled(pos, ImVec2(pos.x + width * meterFraction(r.peak), pos.y + height),
+                            IM_COL32(90,160,90,255));
+    drawList->AddRectFilled(pos, ImVec2(pos.x + width * meterFraction(r.rms), pos.y + height),
+                            IM_COL32(60,220,60,255));
+    float holdX = pos.x + width * meterFraction(r.hold);
+    drawList->AddLine(ImVec2(holdX, pos.y), ImVec2(holdX, pos.y + height),
+                      r.hold >= 1.0f ? IM_COL32(255,60,60,255) : IM_COL32(255,255,255,255));
+
+    ImVec2 clipPos(pos.x + width + 4.0f, pos.y);
+    drawList->AddRectFilled(clipPos, ImVec2(clipPos.x + clipWidth, clipPos.y + height),
+                            r.clips ? IM_COL32(255,40,40,255) : IM_COL32(70,20,20,255));
+    ImGui::SetCursorScreenPos(clipPos);
+    if (ImGui::InvisibleButton(id, ImVec2(clipWidth, height))) meter.resetClips();
+    ImGui::SameLine();
+    if (r.hold > 0.0f) {
+        ImGui::Text("%6.1f dB", 20.0f * std::log10(r.hold));
+    } else {
+        ImGui::Text("  -inf dB");
     }
-
-    return paContinue;
+    return meterFraction(r.peak) > 0.0f;
 }
 
+// Scope: samples kept from the selected source, and how many of them the
+// oscilloscope shows after the trigger
+static const size_t kScopeHistory = 8192;
+static const size_t kScopeWindow = 1024;
 
-void audioThread()
+// Drain `ring` into the end of `history`, dropping its oldest samples.
+// Returns true if anything new arrived.
+static bool drainScope(ScopeRing& ring, std::vector<float>& history, std::vector<float>& chunk)
 {
-    PaStreamParameters outputParameters;
-    PaStream *stream;
-    PaError err;
-
-    err = Pa_Initialize();
-    if( err != paNoError ) return;
-
-    outputParameters.device = Pa_GetDefaultOutputDevice(); /* default output device */
-    outputParameters.channelCount = 2;       /* stereo output */
-    outputParameters.sampleFormat = paFloat32; /* 32 bit floating point output */
-    outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultHighOutputLatency;
-    outputParameters.hostApiSpecificStreamInfo = NULL;
-
-    err = Pa_OpenStream(
-              &stream,
-              NULL, /* no input */
-              &outputParameters,
-              SAMPLE_RATE,
-              FRAMES_PER_BUFFER,
-              paClipOff,      /* we won't output out of range samples so don't bother clipping them */
-              patestCallback,
-              NULL );
-    if( err != paNoError ) return;
-
-    err = Pa_StartStream( stream );
-    if( err != paNoError ) return;
-
-    while (audioRunning)
-    {
-        Pa_Sleep(10);
+    size_t n = ring.read(chunk.data(), chunk.size());
+    if (n == 0) return false;
+    if (n >= history.size()) {
+        std::copy(chunk.begin() + (n - history.size()), chunk.begin() + n, history.begin());
+    } else {
+        std::copy(history.begin() + n, history.end(), history.begin());
+        std::copy(chunk.begin(), chunk.begin() + n, history.end() - n);
     }
+    return true;
+}
 
-    err = Pa_StopStream( stream );
-    if( err != paNoError ) return;
-
-    err = Pa_CloseStream( stream );
-    if( err != paNoError ) return;
-
-    Pa_Terminate();
+// Start of the oscilloscope window: the latest rising zero crossing that
+// still leaves a full window after it, or just the latest window
+static size_t scopeTrigger(const std::vector<float>& history)
+{
+    size_t last = history.size() - kScopeWindow;
+    for (size_t i = last; i > last - kScopeWindow; --i) {
+        if (history[i - 1] < 0.0f && history[i] >= 0.0f) return i;
+    }
+    return last;
 }
 
+// Queue an edit of the clip shown as `view` on `track`. The clip is found
+// again by its take when the edit runs, and the track is reindexed.
+static void postClipEdit(size_t track, const Clip& view, std::function<void(Clip&)> edit)
+{
+    engine.post([track, view, edit](AudioEngine& e) {
+        Instrument &inst = e.instruments[track];
+        for (Clip& clip : inst.clips) {
+            if (clip.take == view.take && clip.notes == view.notes) {
+                edit(clip);
+                inst.reindex(e.getSampleRate());
+                return;
+            }
+        }
+    });
+}
 
-int main()
+int main(int argc, char** argv)
 {
+    Options options;
+    std::string error;
+    if (!parseOptions(argc, argv, options, error)) {
+        std::cerr << error << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (options.showHelp) {
+        printUsage(argv[0]);
+        return 0;
+    }
 
     // Setup window
     glfwInit();
@@ -178,22 +155,78 @@ int main()
     ImGui::StyleColorsDark();
 
     // Setup Platform/Renderer bindings
+    // Octave keys. Registered once, before the ImGui backend installs its
+    // own callbacks, which then pass key events on to this one.
+    glfwSetKeyCallback(window, key_callback);
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init();
 
-    // Create a default instrument
-    {
-        std::lock_guard<std::mutex> lock(instrumentsMutex);
-        instruments.emplace_back("Instrument 1");
+    // Timeline images, freed before the GL context goes away
+    TimelineCache timelineCache;
+
+    // Scope source (0 is the master, then one per track) and what has been
+    // read from it
+    int scopeSource = 0;
+    std::vector<float> scopeHistory(kScopeHistory, 0.0f);
+    std::vector<float> scopeChunk(ScopeRing::kCapacity);
+    SpectrumAnalyzer spectrum;
+
+    // Start audio processing in a separate thread and create a default instrument
+    engine.start(options.audio);
+    engine.addInstrument("Instrument 1");
+    for (const std::string& file : options.trackFiles) {
+        try {
+            engine.addTrack(file.substr(file.find_last_of('/') + 1), file);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
     }
 
-    // Start audio processing in a separate thread
-    std::thread audio(audioThread);
+    // Audio settings being edited in the UI
+    AudioSettings uiSettings = engine.getSettings();
+    // Why the last Apply was refused, if it was
+    std::string settingsStatus;
+
+    // Offline bounce requested from the UI, run between frames so the
+    // instruments lock is not held
+    char bouncePath[256] = "bounce.wav";
+    bool bounceRequested = false;
+    std::string bounceStatus;
+
+    // While something moves on screen, frames are paced by the FPS cap.
+    // Otherwise the loop sleeps until there is input, so an idle editor
+    // leaves the CPU to the audio engine.
+    const std::chrono::duration<double> framePeriod(1.0 / options.fpsCap);
+    std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+    bool animating = true;
+    int settleFrames = 0;
 
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        if (animating) {
+            std::this_thread::sleep_until(nextFrame);
+            glfwPollEvents();
+        } else {
+            // Wake up now and then anyway to keep the load figures current
+            glfwWaitEventsTimeout(kIdleRedrawSeconds);
+            // ImGui needs a couple of frames to settle after input
+            settleFrames = 2;
+        }
+        nextFrame = std::max(nextFrame + std::chrono::duration_cast<std::chrono::steady_clock::duration>(framePeriod),
+                             std::chrono::steady_clock::now());
+
+        if (bounceRequested) {
+            bounceRequested = false;
+            try {
+                OfflineRenderResult result = engine.renderOffline(bouncePath);
+                double seconds = result.frames / engine.getSampleRate();
+                bounceStatus = "Rendered " + std::to_string(seconds) + " s in " +
+                               std::to_string(result.wallSeconds) + " s";
+            } catch (const std::exception& e) {
+                bounceStatus = e.what();
+            }
+        }
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -201,150 +234,437 @@ int main()
         ImGui::NewFrame();
 
         // Route keyboard to current instrument
-        if (!instruments.empty()) {
-            Keyboard(window, instruments[currentInstrument].voices, instrumentsMutex, keyPressed,
-                     instruments[currentInstrument].waveform);
+        if (!engine.instruments.empty()) {
+            Instrument &target = engine.instruments[currentInstrument];
+            Keyboard(window, target.voices, engine.instrumentsMutex, keyPressed,
+                     target.waveform, engine.getSampleRate(),
+                     [&target](int note, bool on) { target.recordNote(note, on); });
         }
-        glfwSetKeyCallback(window, key_callback);
 
         ImGui::Begin("Music Editor");
         if (ImGui::Button("Add Instrument")) {
-            std::lock_guard<std::mutex> lock(instrumentsMutex);
-            std::string name = "Instrument " + std::to_string(instruments.size() + 1);
-            instruments.emplace_back(name);
+            engine.addInstrument("Instrument " + std::to_string(engine.instruments.size() + 1));
         }
 
-        float masterVol = volume.load();
+        float masterVol = engine.volume.load();
         if (ImGui::SliderFloat("Master Volume", &masterVol, 0.0f, 1.0f)) {
-            volume.store(masterVol);
+            engine.volume.store(masterVol);
+        }
+        bool limiterOn = engine.limiterEnabled.load();
+        if (ImGui::Checkbox("Limiter", &limiterOn)) {
+            engine.limiterEnabled.store(limiterOn);
+        }
+        ImGui::SameLine();
+        float ceilingDb = 20.0f * std::log10(engine.limiterCeiling.load());
+        if (ImGui::SliderFloat("Ceiling (dB)", &ceilingDb, -12.0f, 0.0f, "%.1f")) {
+            engine.limiterCeiling.store(std::pow(10.0f, ceilingDb / 20.0f));
+        }
+        ImGui::SameLine();
+        ImGui::Text("GR %.1f dB", 20.0f * std::log10(engine.limiterGain.load()));
+        bool metering = drawMeter("##masterclip", engine.masterMeter);
+
+        float delayTime = engine.delaySeconds.load();
+        if (ImGui::SliderFloat("Delay Time", &delayTime, 0.01f, 2.0f)) {
+            engine.delaySeconds.store(delayTime);
+        }
+        float delayFeedback = engine.delayFeedback.load();
+        if (ImGui::SliderFloat("Delay Feedback", &delayFeedback, 0.0f, 0.95f)) {
+            engine.delayFeedback.store(delayFeedback);
+        }
+
+        if (ImGui::CollapsingHeader("Audio Settings")) {
+            const int rates[] = { 44100, 48000, 88200, 96000 };
+            const char* rateNames[] = { "44100 Hz", "48000 Hz", "88200 Hz", "96000 Hz" };
+            const int sizes[] = { 64, 128, 256, 512, 1024, 2048 };
+            const char* sizeNames[] = { "64", "128", "256", "512", "1024", "2048" };
+            int rateItem = 1;
+            for (int i = 0; i < IM_ARRAYSIZE(rates); ++i) {
+                if (uiSettings.sampleRate == rates[i]) rateItem = i;
+            }
+            int sizeItem = 4;
+            for (int i = 0; i < IM_ARRAYSIZE(sizes); ++i) {
+                if (uiSettings.framesPerBuffer == (unsigned long)sizes[i]) sizeItem = i;
+            }
+            if (ImGui::Combo("Sample Rate", &rateItem, rateNames, IM_ARRAYSIZE(rateNames))) {
+                uiSettings.sampleRate = rates[rateItem];
+            }
+            if (ImGui::Combo("Buffer Size", &sizeItem, sizeNames, IM_ARRAYSIZE(sizeNames))) {
+                uiSettings.framesPerBuffer = sizes[sizeItem];
+            }
+            ImGui::Checkbox("Low Latency", &uiSettings.lowLatency);
+            if (ImGui::Button("Apply") && !engine.isReconfiguring()) {
+                try {
+                    engine.reconfigure(uiSettings);
+                    settingsStatus.clear();
+                } catch (const std::exception& e) {
+                    settingsStatus = e.what();
+                }
+            }
+            if (!settingsStatus.empty()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", settingsStatus.c_str());
+            }
+            AudioSettings active = engine.getSettings();
+            ImGui::Text("Active: %.0f Hz, %lu frames (%.1f ms), output latency %.1f ms + limiter %.1f ms",
+                        active.sampleRate, active.framesPerBuffer,
+                        1000.0 * active.framesPerBuffer / active.sampleRate,
+                        1000.0 * engine.getOutputLatency(), 1000.0 * engine.getProcessingLatency());
+            std::string backendError = engine.getBackendError();
+            if (!backendError.empty()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", backendError.c_str());
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Performance")) {
+            LoadMeter::Snapshot stats = engine.loadMeter.snapshot();
+            ImGui::Text("DSP load: %.1f%%", stats.loadPercent);
+            ImGui::Text("Callback: last %.3f ms, worst %.3f ms, deadline %.3f ms",
+                        stats.lastNs / 1e6, stats.worstNs / 1e6, stats.deadlineNs / 1e6);
+            ImGui::Text("Dropouts: %llu xruns, %llu late callbacks, %llu lock misses (%llu callbacks)",
+                        (unsigned long long)stats.xruns, (unsigned long long)stats.lateCallbacks,
+                        (unsigned long long)stats.lockMisses, (unsigned long long)stats.callbacks);
+            float counts[LoadMeter::kBuckets];
+            for (int i = 0; i < LoadMeter::kBuckets; ++i) counts[i] = (float)stats.histogram[i];
+            ImGui::PlotHistogram("Load histogram", counts, LoadMeter::kBuckets, 0,
+                                 "0% .. 200% of deadline", 0.0f, 3.4e38f, ImVec2(0, 60));
+            std::string realtime = engine.getRealtimeReport();
+            ImGui::TextUnformatted(realtime.c_str());
+            if (ImGui::Button("Reset Stats")) {
+                engine.loadMeter.reset();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Dump Stats")) {
+                std::ofstream file("synth-stats.json");
+                engine.loadMeter.writeJson(file);
+            }
         }
 
-        std::lock_guard<std::mutex> lock(instrumentsMutex);
-        if (!instruments.empty()) {
+        // Apply last frame's edits and take the state to show; the rest of
+        // the frame works on this copy without the instruments lock
+        std::shared_ptr<const UiSnapshot> ui = engine.sync();
+        const std::vector<TrackSnapshot>& tracks = ui->tracks;
+        const float sampleRate = static_cast<float>(ui->sampleRate);
+        if (currentInstrument >= (int)tracks.size()) currentInstrument = 0;
+        if (!tracks.empty()) {
             std::vector<const char*> names;
-            names.reserve(instruments.size());
-            for (auto& inst : instruments) names.push_back(inst.name.c_str());
+            names.reserve(tracks.size());
+            for (auto& t : tracks) names.push_back(t.name.c_str());
             ImGui::Combo("Current Instrument", &currentInstrument, names.data(), names.size());
 
-            Instrument &inst = instruments[currentInstrument];
+            const TrackSnapshot &track = tracks[currentInstrument];
+            size_t idx = static_cast<size_t>(currentInstrument);
             const char* items[] = { "sine", "square", "sawtooth", "triangle", "noise" };
             int currentItem = 0;
             for (int i = 0; i < 5; ++i) {
-                if (inst.waveform == items[i]) currentItem = i;
+                if (track.waveform == items[i]) currentItem = i;
             }
             if (ImGui::Combo("Waveform", &currentItem, items, IM_ARRAYSIZE(items))) {
-                inst.waveform = items[currentItem];
-                for (auto &v : inst.voices) {
-                    v.osc.setWaveform(inst.waveform);
-                }
+                std::string waveform = items[currentItem];
+                engine.post([idx, waveform](AudioEngine& e) {
+                    Instrument &inst = e.instruments[idx];
+                    inst.waveform = waveform;
+                    for (auto &v : inst.voices) {
+                        v.osc.setWaveform(inst.waveform, true);
+                    }
+                });
             }
 
-            ImGui::SliderFloat("Track Volume", &inst.volume, 0.0f, 1.0f);
-            ImGui::Checkbox("Mute", &inst.mute);
+            float volume = track.volume;
+            if (ImGui::SliderFloat("Track Volume", &volume, 0.0f, 1.0f)) {
+                engine.post([idx, volume](AudioEngine& e) { e.instruments[idx].volume = volume; });
+            }
+            float pan = track.pan;
+            if (ImGui::SliderFloat("Pan", &pan, -1.0f, 1.0f, "%.2f")) {
+                engine.post([idx, pan](AudioEngine& e) { e.instruments[idx].pan = pan; });
+            }
+            float spread = track.spread;
+            if (ImGui::SliderFloat("Stereo Spread", &spread, 0.0f, 1.0f, "%.2f")) {
+                engine.post([idx, spread](AudioEngine& e) { e.instruments[idx].spread = spread; });
+            }
+            bool mute = track.mute;
+            if (ImGui::Checkbox("Mute", &mute)) {
+                engine.post([idx, mute](AudioEngine& e) { e.instruments[idx].mute = mute; });
+            }
+            ImGui::SameLine();
+            bool softClip = track.softClip;
+            if (ImGui::Checkbox("Soft Clip", &softClip)) {
+                engine.post([idx, softClip](AudioEngine& e) { e.instruments[idx].softClip = softClip; });
+            }
+            float send = track.sendLevel;
+            if (ImGui::SliderFloat("Delay Send", &send, 0.0f, 1.0f)) {
+                engine.instruments[idx].sendLevel.store(send);
+            }
 
-            if (!inst.isRecording) {
+            if (!track.isRecording) {
+                bool recordNotes = track.recordNotes;
+                if (ImGui::Checkbox("Record Notes", &recordNotes)) {
+                    engine.post([idx, recordNotes](AudioEngine& e) { e.instruments[idx].recordNotes = recordNotes; });
+                }
+                ImGui::SameLine();
                 if (ImGui::Button("Record")) {
-                    inst.recorded.clear();
-                    inst.playIndex = 0;
-                    inst.isPlaying = false;
-                    inst.isRecording = true;
+                    engine.post([idx](AudioEngine& e) {
+                        Instrument &inst = e.instruments[idx];
+                        double rate = e.getSampleRate();
+                        // Overdub at the playhead, otherwise after the last clip
+                        double start = inst.isPlaying ? inst.playIndex / rate : inst.length(rate);
+                        inst.startTake(start, rate);
+                    });
                 }
             } else {
                 ImGui::Text("Recording...");
+                if (track.droppedFrames > 0) {
+                    ImGui::SameLine();
+                    ImGui::Text("(%llu frames dropped)", (unsigned long long)track.droppedFrames);
+                }
                 if (ImGui::Button("Stop")) {
-                    inst.isRecording = false;
+                    engine.post([idx](AudioEngine& e) { e.instruments[idx].stopTake(e.getSampleRate()); });
                 }
             }
             if (ImGui::Button("Clear Track")) {
-                inst.recorded.clear();
-                inst.playIndex = 0;
+                engine.post([idx](AudioEngine& e) { e.instruments[idx].clearClips(e.getSampleRate()); });
+                selectedClip = -1;
+            }
+
+            // Selected clip, picked on the timeline
+            if (selectedTrack == currentInstrument && selectedClip >= 0 &&
+                selectedClip < (int)track.clips.size()) {
+                const ClipSnapshot &shown = track.clips[selectedClip];
+                const Clip &clip = shown.clip;
+                ImGui::Text("Clip %d at %.2f s, %.2f s long", selectedClip + 1, clip.start,
+                            shown.frames / sampleRate);
+                float gain = clip.gain;
+                if (ImGui::SliderFloat("Clip Gain", &gain, 0.0f, 2.0f)) {
+                    postClipEdit(idx, clip, [gain](Clip& c) { c.gain = gain; });
+                }
+                if (clip.notes && !shown.recording) {
+                    // Note clips are re-rendered, so their sound stays editable
+                    ImGui::Text("%zu note events", clip.notes->getEvents().size());
+                    int clipWave = 0;
+                    for (int i = 0; i < 5; ++i) {
+                        if (clip.notes->getWaveform() == items[i]) clipWave = i;
+                    }
+                    if (ImGui::Combo("Clip Waveform", &clipWave, items, IM_ARRAYSIZE(items))) {
+                        std::string waveform = items[clipWave];
+                        postClipEdit(idx, clip, [waveform](Clip& c) { c.notes->setWaveform(waveform); });
+                    }
+                    float tempo = static_cast<float>(clip.notes->getTempo());
+                    if (ImGui::SliderFloat("Clip Tempo", &tempo, 0.5f, 2.0f, "%.2fx")) {
+                        postClipEdit(idx, clip, [tempo](Clip& c) { c.notes->setTempo(tempo); });
+                    }
+                }
+                if (!shown.spoolPath.empty()) {
+                    ImGui::Text("Take: %s", shown.spoolPath.c_str());
+                }
+                if (ImGui::Button("Delete Clip") && !shown.recording) {
+                    Clip removed = clip;
+                    engine.post([idx, removed](AudioEngine& e) {
+                        Instrument &inst = e.instruments[idx];
+                        inst.clips.erase(std::remove_if(inst.clips.begin(), inst.clips.end(), [&](const Clip& c) {
+                                             return c.take == removed.take && c.notes == removed.notes;
+                                         }),
+                                         inst.clips.end());
+                        inst.reindex(e.getSampleRate());
+                    });
+                    selectedClip = -1;
+                }
             }
         }
 
         ImGui::Separator();
+        Transport &transport = engine.transport;
+        float bpm = static_cast<float>(transport.bpm.load());
+        if (ImGui::SliderFloat("Tempo (BPM)", &bpm, 40.0f, 240.0f, "%.1f")) {
+            transport.bpm.store(bpm);
+        }
+        bool looping = transport.looping.load();
+        if (ImGui::Checkbox("Loop", &looping)) {
+            transport.looping.store(looping);
+        }
+        float loopBeats[2] = { static_cast<float>(transport.loopStart.load()),
+                               static_cast<float>(transport.loopEnd.load()) };
+        if (ImGui::DragFloat2("Loop Start/End (beats)", loopBeats, 0.25f, 0.0f, 1024.0f, "%.2f")) {
+            // Whole sixteenths, and never an empty loop
+            loopBeats[0] = std::round(loopBeats[0] * 4.0f) / 4.0f;
+            loopBeats[1] = std::max(loopBeats[0] + 0.25f, std::round(loopBeats[1] * 4.0f) / 4.0f);
+            transport.loopStart.store(loopBeats[0]);
+            transport.loopEnd.store(loopBeats[1]);
+        }
+        float fadeMs = transport.crossfadeSeconds.load() * 1000.0f;
+        if (ImGui::SliderFloat("Loop Crossfade (ms)", &fadeMs, 0.0f, 50.0f, "%.1f")) {
+            transport.crossfadeSeconds.store(fadeMs / 1000.0f);
+        }
         if (ImGui::Button("Master Play")) {
-            for (auto &inst : instruments) {
-                if (!inst.recorded.empty()) {
-                    inst.playIndex = 0;
-                    inst.isPlaying = true;
+            engine.post([](AudioEngine& e) {
+                for (auto &inst : e.instruments) {
+                    if (!inst.clips.empty()) {
+                        inst.playIndex = 0;
+                        inst.isPlaying = true;
+                    }
                 }
-            }
+            });
         }
         ImGui::SameLine();
         if (ImGui::Button("Master Stop")) {
-            for (auto &inst : instruments) {
-                inst.isPlaying = false;
-                inst.playIndex = 0;
+            engine.post([](AudioEngine& e) {
+                for (auto &inst : e.instruments) {
+                    inst.isPlaying = false;
+                    inst.playIndex = 0;
+                }
+            });
+        }
+
+        ImGui::InputText("Bounce File", bouncePath, sizeof(bouncePath));
+        ImGui::SameLine();
+        if (ImGui::Button("Bounce to WAV")) {
+            bounceRequested = true;
+        }
+        if (!bounceStatus.empty()) {
+            ImGui::Text("%s", bounceStatus.c_str());
+        }
+
+        if (ImGui::CollapsingHeader("Track Meters", ImGuiTreeNodeFlags_DefaultOpen)) {
+            for (size_t i = 0; i < tracks.size(); ++i) {
+                ImGui::Text("%-16.16s", tracks[i].name.c_str());
+                ImGui::SameLine();
+                std::string id = "##clip" + std::to_string(i);
+                metering = drawMeter(id.c_str(), engine.instruments[i].meter) || metering;
             }
         }
 
         ImGui::Separator();
         ImGui::Text("Timeline");
-        if (!instruments.empty()) {
+        if (!tracks.empty()) {
             const float trackHeight = 60.0f;
             float timelineWidth = ImGui::GetContentRegionAvail().x - 10.0f;
             float maxLength = 10.0f;
-            for (auto &inst : instruments) {
-                float len = inst.offsetSeconds + inst.recorded.size() / static_cast<float>(SAMPLE_RATE);
-                maxLength = std::max(maxLength, len);
+            for (auto &t : tracks) {
+                maxLength = std::max(maxLength, static_cast<float>(t.length));
             }
             float snap = 0.25f; // seconds
             ImVec2 startPos = ImGui::GetCursorScreenPos();
             ImDrawList* drawList = ImGui::GetWindowDrawList();
-            float totalHeight = trackHeight * instruments.size();
+            float totalHeight = trackHeight * tracks.size();
 
+            // Track rows and grid come from one cached image
             int divs = static_cast<int>(maxLength / snap);
-            for (int i = 0; i <= divs; ++i) {
+            GLuint grid = timelineCache.grid(static_cast<int>(timelineWidth), static_cast<int>(totalHeight),
+                                             static_cast<int>(tracks.size()), divs);
+            if (grid) {
+                drawList->AddImage((ImTextureID)(intptr_t)grid, startPos,
+                                   ImVec2(startPos.x + static_cast<int>(timelineWidth), startPos.y + totalHeight));
+            }
+            for (int i = 0; i <= divs; i += 4) {
                 float x = startPos.x + (i * timelineWidth) / divs;
-                drawList->AddLine(ImVec2(x, startPos.y), ImVec2(x, startPos.y + totalHeight), IM_COL32(80,80,80,255));
-                if (i % 4 == 0) {
-                    std::string t = std::to_string(i * snap);
-                    drawList->AddText(ImVec2(x + 2, startPos.y - 15), IM_COL32(255,255,255,255), t.c_str());
-                }
+                std::string t = std::to_string(i * snap);
+                drawList->AddText(ImVec2(x + 2, startPos.y - 15), IM_COL32(255,255,255,255), t.c_str());
+            }
+
+            // Loop region
+            if (transport.looping.load()) {
+                double beatSeconds = 60.0 / transport.bpm.load();
+                float x0 = startPos.x + static_cast<float>(transport.loopStart.load() * beatSeconds / maxLength) * timelineWidth;
+                float x1 = startPos.x + static_cast<float>(transport.loopEnd.load() * beatSeconds / maxLength) * timelineWidth;
+                drawList->AddRectFilled(ImVec2(x0, startPos.y), ImVec2(x1, startPos.y + totalHeight), IM_COL32(255,220,0,30));
             }
 
             static int draggedTrack = -1;
-            for (size_t idx = 0; idx < instruments.size(); ++idx) {
-                Instrument &inst = instruments[idx];
+            static int draggedClip = -1;
+            for (size_t idx = 0; idx < tracks.size(); ++idx) {
+                const TrackSnapshot &t = tracks[idx];
                 float y = startPos.y + idx * trackHeight;
-                drawList->AddRectFilled(ImVec2(startPos.x, y), ImVec2(startPos.x + timelineWidth, y + trackHeight), IM_COL32(50,50,50,200));
-                float trackStart = startPos.x + (inst.offsetSeconds / maxLength) * timelineWidth;
-                float trackLenSec = inst.recorded.size() / static_cast<float>(SAMPLE_RATE);
-                float trackWidth = (trackLenSec / maxLength) * timelineWidth;
-                ImVec2 rectMin(trackStart, y + 5);
-                ImVec2 rectMax(trackStart + trackWidth, y + trackHeight - 5);
-                drawList->AddRectFilled(rectMin, rectMax, IM_COL32(100,150,240,255));
-                drawList->AddRect(rectMin, rectMax, IM_COL32(255,255,255,255));
-
-                if (!inst.recorded.empty() && trackWidth > 0) {
-                    float midY = (rectMin.y + rectMax.y) * 0.5f;
-                    for (int x = 0; x < (int)trackWidth; ++x) {
-                        size_t idxSample = static_cast<size_t>((float)x / trackWidth * inst.recorded.size());
-                        float s = inst.recorded[idxSample];
-                        drawList->AddLine(ImVec2(rectMin.x + x, midY),
-                                          ImVec2(rectMin.x + x, midY - s * (trackHeight/2 - 5)),
-                                          IM_COL32(255,255,255,100));
-                    }
-                }
 
-                if (trackWidth > 0.0f)
-                {
-                    ImGui::SetCursorScreenPos(rectMin);
-                    ImGui::InvisibleButton(("track" + std::to_string(idx)).c_str(), ImVec2(trackWidth, trackHeight - 10));
-                    if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
-                        float delta = ImGui::GetIO().MouseDelta.x;
-                        float deltaSeconds = delta / timelineWidth * maxLength;
-                        inst.offsetSeconds = std::max(0.0f, inst.offsetSeconds + deltaSeconds);
-                        draggedTrack = (int)idx;
+                for (size_t c = 0; c < t.clips.size(); ++c) {
+                    const Clip &clip = t.clips[c].clip;
+                    size_t clipFrames = t.clips[c].frames;
+                    float clipStart = startPos.x + (clip.start / maxLength) * timelineWidth;
+                    float clipWidth = (clipFrames / sampleRate / maxLength) * timelineWidth;
+                    bool selected = selectedTrack == (int)idx && selectedClip == (int)c;
+                    ImVec2 rectMin(clipStart, y + 5);
+                    ImVec2 rectMax(clipStart + clipWidth, y + trackHeight - 5);
+                    drawList->AddRectFilled(rectMin, rectMax, IM_COL32(100,150,240,255));
+
+                    GLuint image = timelineCache.clip(clip, static_cast<int>(clipWidth + 0.5f),
+                                                      static_cast<int>(rectMax.y - rectMin.y), sampleRate);
+                    if (image) {
+                        drawList->AddImage((ImTextureID)(intptr_t)image, rectMin,
+                                           ImVec2(rectMin.x + static_cast<int>(clipWidth + 0.5f), rectMax.y));
                     }
-                    if (draggedTrack == (int)idx && !ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
-                        inst.offsetSeconds = std::round(inst.offsetSeconds / snap) * snap;
-                        draggedTrack = -1;
+                    drawList->AddRect(rectMin, rectMax, selected ? IM_COL32(255,220,0,255) : IM_COL32(255,255,255,255));
+
+                    if (clipWidth > 0.0f)
+                    {
+                        ImGui::SetCursorScreenPos(rectMin);
+                        ImGui::InvisibleButton(("clip" + std::to_string(idx) + "_" + std::to_string(c)).c_str(),
+                                               ImVec2(std::max(clipWidth, 1.0f), trackHeight - 10));
+                        if (ImGui::IsItemClicked()) {
+                            selectedTrack = (int)idx;
+                            selectedClip = (int)c;
+                            currentInstrument = (int)idx;
+                        }
+                        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+                            float delta = ImGui::GetIO().MouseDelta.x;
+                            double start = std::max(0.0, clip.start + delta / timelineWidth * maxLength);
+                            postClipEdit(idx, clip, [start](Clip& moved) { moved.start = start; });
+                            draggedTrack = (int)idx;
+                            draggedClip = (int)c;
+                        }
+                        if (draggedTrack == (int)idx && draggedClip == (int)c && !ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+                            postClipEdit(idx, clip, [snap](Clip& moved) {
+                                moved.start = std::round(moved.start / snap) * snap;
+                            });
+                            draggedTrack = -1;
+                            draggedClip = -1;
+                        }
                     }
                 }
             }
             ImGui::Dummy(ImVec2(timelineWidth, totalHeight));
         }
+        timelineCache.collect();
+
+        // Oscilloscope and spectrum of the master or one track. The audio
+        // thread only copies samples into the rings; everything else
+        // happens here. Rings not being shown are emptied so that switching
+        // source starts from current audio.
+        bool scopeOpen = ImGui::CollapsingHeader("Scope");
+        if (scopeOpen) {
+            std::vector<std::string> sources(1, "Master");
+            for (const TrackSnapshot &t : tracks) sources.push_back(t.name);
+            std::vector<const char*> sourceNames;
+            for (const std::string& name : sources) sourceNames.push_back(name.c_str());
+            if (scopeSource >= (int)sourceNames.size()) scopeSource = 0;
+            if (ImGui::Combo("Source", &scopeSource, sourceNames.data(), sourceNames.size())) {
+                std::fill(scopeHistory.begin(), scopeHistory.end(), 0.0f);
+            }
+        }
+        for (size_t i = 0; i <= tracks.size(); ++i) {
+            ScopeRing& ring = i == 0 ? engine.masterScope : engine.instruments[i - 1].scope;
+            if (scopeOpen && (int)i == scopeSource) {
+                if (drainScope(ring, scopeHistory, scopeChunk)) {
+                    spectrum.analyze(scopeHistory.data() + (kScopeHistory - SpectrumAnalyzer::kSize),
+                                     ui->sampleRate);
+                }
+            } else {
+                ring.discard();
+            }
+        }
+        if (scopeOpen) {
+            ImGui::PlotLines("Waveform##scope", scopeHistory.data() + scopeTrigger(scopeHistory),
+                             kScopeWindow, 0, nullptr, -1.0f, 1.0f, ImVec2(0, 120));
+            const std::vector<float>& levels = spectrum.levels();
+            ImGui::PlotLines("Spectrum##scope", levels.data(), levels.size(), 0,
+                             "20 Hz .. Nyquist, -90 .. 0 dB", -90.0f, 0.0f, ImVec2(0, 120));
+        }
+
+        // Keep drawing at the capped rate while playing, recording, playing
+        // keys, interacting, showing the scope or while meters are moving,
+        // and go idle otherwise
+        bool transportRunning = false;
+        for (const TrackSnapshot &t : tracks) {
+            transportRunning = transportRunning || t.isPlaying || t.isRecording;
+        }
+        if (settleFrames > 0) --settleFrames;
+        animating = transportRunning || keyPressed.load() || bounceRequested || settleFrames > 0 || scopeOpen || metering ||
+                    ImGui::IsAnyItemActive() || ImGui::IsMouseDown(ImGuiMouseButton_Left);
 
         ImGui::End();
 
@@ -361,6 +681,7 @@ int main()
     }
 
     // Cleanup
+    timelineCache.release();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -369,8 +690,12 @@ int main()
     glfwTerminate();
 
     // Stop the audio thread
-    audioRunning = false;
-    audio.join();
+    engine.stop();
+
+    if (!options.statsFile.empty()) {
+        std::ofstream file(options.statsFile);
+        engine.loadMeter.writeJson(file);
+    }
 
     return 0;
 }
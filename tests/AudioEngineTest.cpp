@@ -0,0 +1,131 @@
+#include "Check.h"
+#include "AudioEngine.h"
+#include "RealtimeGuard.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// A sequence played through the engine as the stream callback would,
+// with the real-time guard watching (./make.sh test builds it in)
+TEST(engineSequenceIsRealtimeSafe)
+{
+    AudioSettings settings;
+    settings.backend = "null";
+    settings.framesPerBuffer = 256;
+    settings.workerThreads = 2;
+    AudioEngine engine;
+    engine.configure(settings);
+    engine.addInstrument("lead");
+    engine.addInstrument("bass");
+
+    std::vector<NoteEvent> events;
+    for (int i = 0; i < 16; ++i) {
+        events.push_back(NoteEvent(i * 0.05, i % 2, 48 + i, true));
+        events.push_back(NoteEvent(i * 0.05 + 0.12, i % 2, 48 + i, false));
+    }
+    engine.setSequence(events);
+
+    uint64_t before = realtimeViolationCount();
+    std::vector<float> out(2 * settings.framesPerBuffer);
+    float peak = 0.0f;
+    for (int block = 0; block < 400 && !engine.isSequenceFinished(); ++block) {
+        engine.renderAudio(out.data(), settings.framesPerBuffer, false);
+        for (float v : out) peak = std::max(peak, std::fabs(v));
+    }
+    CHECK(engine.isSequenceFinished());
+    CHECK(peak > 0.1f);
+    CHECK(peak <= engine.limiterCeiling.load() + 1e-6f);
+    CHECK(realtimeViolationCount() == before);
+}
+
+// An edit holding the lock must cost the stream a silent block, not a wait
+TEST(engineRenderNeverWaitsForTheLock)
+{
+    AudioSettings settings;
+    settings.backend = "null";
+    settings.workerThreads = 0;
+    AudioEngine engine;
+    engine.configure(settings);
+    engine.addInstrument("lead");
+    engine.noteOn(0, 69);
+
+    std::vector<float> out(2 * 256, 1.0f);
+    uint64_t misses = engine.loadMeter.snapshot().lockMisses;
+    uint64_t busy = realtimeLockBusyCount();
+    uint64_t violations = realtimeViolationCount();
+    std::atomic<bool> locked(false), rendered(false);
+    std::thread editor([&]() {
+        std::lock_guard<std::mutex> lock(engine.instrumentsMutex);
+        locked = true;
+        while (!rendered) std::this_thread::yield();
+    });
+    while (!locked) std::this_thread::yield();
+    engine.renderAudio(out.data(), 256, false);
+    rendered = true;
+    editor.join();
+    CHECK(engine.loadMeter.snapshot().lockMisses == misses + 1);
+#if defined(SYNTH_RT_GUARD)
+    // Reported by the checker, but not as a violation: nothing waited
+    CHECK(realtimeLockBusyCount() == busy + 1);
+    CHECK(realtimeViolationCount() == violations);
+#else
+    (void) busy;
+    (void) violations;
+#endif
+    for (float v : out) CHECK(v == 0.0f);
+
+    float peak = 0.0f;
+    for (int block = 0; block < 4; ++block) {
+        engine.renderAudio(out.data(), 256, false);
+        for (float v : out) peak = std::max(peak, std::fabs(v));
+    }
+    CHECK(peak > 0.5f);
+}
+
+// Settings can't change under a take being recorded; once it stops they
+// can, and the take is converted
+TEST(engineRefusesReconfigureWhileRecording)
+{
+    AudioSettings settings;
+    settings.backend = "null";
+    settings.workerThreads = 0;
+    AudioEngine engine;
+    engine.configure(settings);
+    engine.addInstrument("lead");
+    {
+        std::lock_guard<std::mutex> lock(engine.instrumentsMutex);
+        engine.instruments[0].startTake(0.0, engine.getSampleRate());
+    }
+
+    AudioSettings faster = settings;
+    faster.sampleRate = 96000.0;
+    bool refused = false;
+    try {
+        engine.reconfigure(faster);
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    CHECK(refused);
+    CHECK(!engine.isReconfiguring());
+    refused = false;
+    try {
+        engine.configure(faster);
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    CHECK(refused);
+    CHECK(engine.getSampleRate() == settings.sampleRate);
+
+    {
+        std::lock_guard<std::mutex> lock(engine.instrumentsMutex);
+        engine.instruments[0].stopTake(engine.getSampleRate());
+    }
+    engine.reconfigure(faster);
+    CHECK(engine.isReconfiguring());
+    engine.configure(faster);
+    CHECK(engine.getSampleRate() == faster.sampleRate);
+}
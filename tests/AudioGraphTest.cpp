@@ -0,0 +1,179 @@
+#include "Check.h"
+#include "AudioGraph.h"
+#include "Instrument.h"
+#include "Transport.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+// Source node playing a fixed stereo signal, one block after another
+class SignalNode : public AudioNode {
+public:
+    SignalNode(const std::vector<float>& left, const std::vector<float>& right)
+        : AudioNode("signal"), left(left), right(right), position(0) {}
+
+    void process(const std::vector<AudioNode*>& inputs, unsigned long frames) override
+    {
+        (void) inputs;
+        for (unsigned long i = 0; i < frames; ++i, ++position) {
+            bool inside = position < left.size();
+            channel(0)[i] = inside ? left[position] : 0.0f;
+            channel(1)[i] = inside ? right[position] : 0.0f;
+        }
+    }
+
+private:
+    std::vector<float> left;
+    std::vector<float> right;
+    size_t position;
+};
+
+// Run the graph over `frames` samples in blocks of `block`
+static void renderGraph(AudioGraph& graph, size_t frames, unsigned long block,
+                        std::vector<float>& left, std::vector<float>& right)
+{
+    left.clear();
+    right.clear();
+    for (size_t done = 0; done < frames; done += block) {
+        unsigned long n = static_cast<unsigned long>(std::min<size_t>(block, frames - done));
+        const AudioNode* out = graph.process(n);
+        left.insert(left.end(), out->output(0), out->output(0) + n);
+        right.insert(right.end(), out->output(1), out->output(1) + n);
+    }
+}
+
+TEST(limiterHoldsTheCeiling)
+{
+    const double rate = 48000.0;
+    const size_t frames = 96000;
+    // Bursts up to +12 dB over a quiet tone, different on each side
+    std::vector<float> left(frames), right(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        float tone = 0.3f * std::sin(i * 0.05f);
+        float burst = (i / 4000) % 3 == 1 ? 4.0f * std::sin(i * 0.013f) : 0.0f;
+        left[i] = tone + burst;
+        right[i] = tone - 0.5f * burst + (i == 50000 ? 3.9f : 0.0f);
+    }
+
+    std::atomic<bool> enabled(true);
+    std::atomic<float> ceiling(0.5f);
+    std::atomic<float> reduction(1.0f);
+    AudioGraph graph(256, 0);
+    AudioNode* source = graph.addNode(std::unique_ptr<AudioNode>(new SignalNode(left, right)));
+    AudioNode* limiter = graph.addNode(std::unique_ptr<AudioNode>(
+        new LimiterNode("limiter", rate, 0.0015, 0.05, enabled, ceiling, reduction)));
+    graph.connect(source, limiter);
+    graph.setOutput(limiter);
+    CHECK(graph.compile());
+
+    std::vector<float> outLeft, outRight;
+    renderGraph(graph, frames, 256, outLeft, outRight);
+    float peak = 0.0f;
+    for (size_t i = 0; i < frames; ++i) {
+        peak = std::max(peak, std::max(std::fabs(outLeft[i]), std::fabs(outRight[i])));
+    }
+    CHECK(peak <= 0.5f + 1e-6f);
+    CHECK(peak > 0.45f);
+    CHECK(reduction.load() < 1.0f);
+}
+
+TEST(limiterOnlyDelaysQuietSignals)
+{
+    const double rate = 48000.0;
+    const size_t frames = 20000;
+    std::vector<float> left(frames), right(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        left[i] = 0.8f * std::sin(i * 0.01f);
+        right[i] = 0.4f * std::cos(i * 0.003f);
+    }
+
+    std::atomic<bool> enabled(true);
+    std::atomic<float> ceiling(0.9f);
+    std::atomic<float> reduction(1.0f);
+    AudioGraph graph(512, 0);
+    AudioNode* source = graph.addNode(std::unique_ptr<AudioNode>(new SignalNode(left, right)));
+    AudioNode* limiter = graph.addNode(std::unique_ptr<AudioNode>(
+        new LimiterNode("limiter", rate, 0.0015, 0.05, enabled, ceiling, reduction)));
+    graph.connect(source, limiter);
+    graph.setOutput(limiter);
+    CHECK(graph.compile());
+    CHECK(limiter->latency() == 72);
+
+    // Switched off halfway: still the same delay, never a gain change
+    std::vector<float> outLeft, outRight, moreLeft, moreRight;
+    renderGraph(graph, frames / 2, 300, outLeft, outRight);
+    enabled = false;
+    renderGraph(graph, frames / 2, 300, moreLeft, moreRight);
+    outLeft.insert(outLeft.end(), moreLeft.begin(), moreLeft.end());
+    outRight.insert(outRight.end(), moreRight.begin(), moreRight.end());
+
+    size_t delay = limiter->latency();
+    for (size_t i = 0; i < delay; ++i) {
+        CHECK(outLeft[i] == 0.0f && outRight[i] == 0.0f);
+    }
+    for (size_t i = delay; i < frames; ++i) {
+        CHECK(outLeft[i] == left[i - delay]);
+        CHECK(outRight[i] == right[i - delay]);
+    }
+    CHECK(reduction.load() == 1.0f);
+}
+
+// Left and right output of an instrument playing A4 on a sine at `pan`
+static void renderPanned(float pan, size_t frames, std::vector<float>& left, std::vector<float>& right)
+{
+    const double rate = 48000.0;
+    Instrument inst("pan");
+    inst.pan = pan;
+    Voice voice(kVoiceTableSize, rate);
+    voice.osc.setWaveform("sine");
+    voice.osc.setNote(69);
+    voice.note = 69;
+    inst.voices.push_back(voice);
+    Transport transport;
+
+    AudioGraph graph(256, 0);
+    AudioNode* node = graph.addNode(std::unique_ptr<AudioNode>(new InstrumentNode(inst, transport, rate)));
+    graph.setOutput(node);
+    graph.compile();
+    renderGraph(graph, frames, 256, left, right);
+}
+
+TEST(panCentreIsUnity)
+{
+    const size_t frames = 4096;
+    std::vector<float> left, right;
+    renderPanned(0.0f, frames, left, right);
+
+    Voice reference(kVoiceTableSize, 48000.0);
+    reference.osc.setWaveform("sine");
+    reference.osc.setNote(69);
+    for (size_t i = 0; i < frames; ++i) {
+        float mono = static_cast<float>(reference.osc.getWaveformValue());
+        CHECK(left[i] == right[i]);
+        CHECK_NEAR(left[i], mono, 1e-6);
+    }
+}
+
+TEST(panKeepsConstantPower)
+{
+    const size_t frames = 1024;
+    std::vector<float> centreLeft, centreRight;
+    renderPanned(0.0f, frames, centreLeft, centreRight);
+    const float pans[] = { -1.0f, -0.6f, 0.25f, 1.0f };
+    for (float pan : pans) {
+        std::vector<float> left, right;
+        renderPanned(pan, frames, left, right);
+        for (size_t i = 0; i < frames; ++i) {
+            double power = left[i] * left[i] + right[i] * right[i];
+            double centre = centreLeft[i] * centreLeft[i] + centreRight[i] * centreRight[i];
+            CHECK_NEAR(power, centre, 1e-5);
+        }
+    }
+    std::vector<float> left, right;
+    renderPanned(-1.0f, frames, left, right);
+    for (size_t i = 0; i < frames; ++i) {
+        CHECK_NEAR(right[i], 0.0, 1e-6);
+    }
+}
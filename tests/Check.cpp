@@ -0,0 +1,54 @@
+#include "Check.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Test {
+    const char* name;
+    TestFunction function;
+};
+
+// Function-local so registrations from any file find it constructed
+std::vector<Test>& tests()
+{
+    static std::vector<Test> list;
+    return list;
+}
+
+int failures = 0;
+
+} // namespace
+
+TestRegistration::TestRegistration(const char* name, TestFunction function)
+{
+    Test t;
+    t.name = name;
+    t.function = function;
+    tests().push_back(t);
+}
+
+void checkFailed(const char* file, int line, const char* expression)
+{
+    ++failures;
+    std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+}
+
+// Runs every test, or only those whose name contains the first argument
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    int run = 0, failed = 0;
+    for (const Test& t : tests()) {
+        if (filter && !std::strstr(t.name, filter)) continue;
+        int before = failures;
+        t.function();
+        ++run;
+        bool passed = failures == before;
+        if (!passed) ++failed;
+        std::cout << (passed ? "ok      " : "FAILED  ") << t.name << std::endl;
+    }
+    std::cout << run - failed << "/" << run << " tests passed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+// Minimal harness for the headless tests. TEST(name) defines and registers
+// a test; CHECK(condition) and CHECK_NEAR(a, b, tolerance) report a failure
+// with its location and let the test carry on, so one run shows every
+// mismatch. Build and run them all with ./make.sh test.
+
+typedef void (*TestFunction)();
+
+// Adds a test to the list run by main(); used by TEST
+struct TestRegistration {
+    TestRegistration(const char* name, TestFunction function);
+};
+
+// Counts a failed check and prints where it happened
+void checkFailed(const char* file, int line, const char* expression);
+
+#define TEST(name)                                                  \
+    static void name();                                             \
+    static TestRegistration name##Registration(#name, name);        \
+    static void name()
+
+#define CHECK(condition)                                            \
+    do {                                                            \
+        if (!(condition)) checkFailed(__FILE__, __LINE__, #condition); \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)                                 \
+    do {                                                            \
+        double checkA = (a), checkB = (b);                          \
+        if (!(std::fabs(checkA - checkB) <= (tolerance))) {         \
+            checkFailed(__FILE__, __LINE__, #a " ~= " #b);          \
+            std::cerr << "    " << checkA << " vs " << checkB << std::endl; \
+        }                                                           \
+    } while (0)
+
+#endif // CHECK_H
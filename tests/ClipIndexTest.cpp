@@ -0,0 +1,121 @@
+#include "Check.h"
+#include "Clip.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Note clips of the given lengths in frames; cheap to make in bulk
+static std::vector<Clip> makeClips(std::mt19937& random, size_t count, double sampleRate)
+{
+    std::uniform_int_distribution<size_t> start(0, 2000000);
+    std::uniform_int_distribution<size_t> length(0, 300000);
+    std::vector<Clip> clips;
+    for (size_t i = 0; i < count; ++i) {
+        std::shared_ptr<NoteTake> take = std::make_shared<NoteTake>("sine");
+        take->start(sampleRate);
+        take->advance(length(random));
+        take->finish(sampleRate);
+        Clip clip(take);
+        clip.start = start(random) / sampleRate;
+        clips.push_back(clip);
+    }
+    return clips;
+}
+
+// Clips overlapping [from, to), found the slow way
+static std::vector<size_t> bruteForce(const std::vector<Clip>& clips, double sampleRate,
+                                      size_t from, size_t to, const void* open)
+{
+    std::vector<size_t> found;
+    for (size_t i = 0; i < clips.size(); ++i) {
+        size_t start = static_cast<size_t>(clips[i].start * sampleRate);
+        size_t end = clips[i].notes.get() == open ? std::numeric_limits<size_t>::max()
+                                                   : start + clips[i].frames();
+        if (start < to && end > from) found.push_back(i);
+    }
+    return found;
+}
+
+static std::vector<size_t> indexed(const ClipIndex& index, size_t from, size_t to)
+{
+    std::vector<size_t> found;
+    index.forEachOverlapping(from, to, [&](const ClipIndex::Entry& e) { found.push_back(e.clip); });
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+TEST(clipIndexMatchesBruteForce)
+{
+    const double rate = 48000.0;
+    std::mt19937 random(26);
+    std::vector<Clip> clips = makeClips(random, 300, rate);
+    ClipIndex index;
+    index.build(clips, rate);
+
+    std::uniform_int_distribution<size_t> position(0, 2400000);
+    std::uniform_int_distribution<size_t> span(1, 100000);
+    for (int q = 0; q < 2000; ++q) {
+        size_t from = position(random);
+        size_t to = from + span(random);
+        CHECK(indexed(index, from, to) == bruteForce(clips, rate, from, to, nullptr));
+    }
+}
+
+TEST(clipIndexTreatsOpenTakeAsEndless)
+{
+    const double rate = 48000.0;
+    std::mt19937 random(27);
+    std::vector<Clip> clips = makeClips(random, 50, rate);
+    const void* open = clips[7].notes.get();
+    ClipIndex index;
+    index.build(clips, rate, open);
+
+    size_t start = static_cast<size_t>(clips[7].start * rate);
+    std::vector<size_t> far = indexed(index, start + 50000000, start + 50001024);
+    CHECK(std::find(far.begin(), far.end(), 7u) != far.end());
+    for (size_t from = 0; from < 3000000; from += 9973) {
+        CHECK(indexed(index, from, from + 4096) == bruteForce(clips, rate, from, from + 4096, open));
+    }
+}
+
+TEST(clipIndexEmpty)
+{
+    ClipIndex index;
+    index.build(std::vector<Clip>(), 48000.0);
+    CHECK(indexed(index, 0, 1000000).empty());
+    CHECK(index.end() == 0);
+}
+
+TEST(clipIndexWithALongClipFirst)
+{
+    // One clip spans the whole timeline; it must not hide or drag in the rest
+    const double rate = 48000.0;
+    std::mt19937 random(28);
+    std::vector<Clip> clips = makeClips(random, 500, rate);
+    std::shared_ptr<NoteTake> take = std::make_shared<NoteTake>("sine");
+    take->start(rate);
+    take->advance(4000000);
+    take->finish(rate);
+    clips.push_back(Clip(take));
+    ClipIndex index;
+    index.build(clips, rate);
+    CHECK(index.end() == 4000000);
+
+    std::uniform_int_distribution<size_t> position(0, 2400000);
+    for (int q = 0; q < 1000; ++q) {
+        size_t from = position(random);
+        size_t to = from + 1024;
+        CHECK(indexed(index, from, to) == bruteForce(clips, rate, from, to, nullptr));
+
+        // Matches come in start order
+        size_t previous = 0;
+        bool ordered = true;
+        index.forEachOverlapping(from, to, [&](const ClipIndex::Entry& e) {
+            ordered = ordered && e.start >= previous;
+            previous = e.start;
+        });
+        CHECK(ordered);
+    }
+}
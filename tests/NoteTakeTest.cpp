@@ -0,0 +1,136 @@
+#include "Check.h"
+#include "NoteTake.h"
+#include <algorithm>
+#include <vector>
+
+// What the engine's allocator thread does for a finished take
+static void buildVoices(NoteTake& take)
+{
+    NoteTake::VoiceBuild build = take.voiceRequest();
+    build.build();
+    take.installVoices(build);
+}
+
+// A take with a note held from frame 1000 to 40000, a second one on top
+// from 3000 to 25000 and a third starting after the first ends
+static void recordTake(NoteTake& take, double rate)
+{
+    take.start(rate);
+    take.advance(1000);
+    take.record(60, true);
+    take.advance(2000);
+    take.record(64, true);
+    take.advance(22000);
+    take.record(64, false);
+    take.advance(15000);
+    take.record(60, false);
+    take.record(67, true);
+    take.advance(8000);
+    take.finish(rate);
+}
+
+static double maxDifference(const std::vector<float>& a, const std::vector<float>& b, size_t from)
+{
+    double worst = 0.0;
+    for (size_t i = from; i < a.size() && i < b.size(); ++i) {
+        worst = std::max(worst, static_cast<double>(std::fabs(a[i] - b[i])));
+    }
+    return worst;
+}
+
+TEST(noteTakeRecordsAndClosesHeldNotes)
+{
+    NoteTake take("sawtooth");
+    recordTake(take, 48000.0);
+    CHECK(take.frames() == 48000);
+    // Five recorded events plus the off for the note held at the end
+    CHECK(take.getEvents().size() == 6);
+    CHECK(!take.getEvents().back().on && take.getEvents().back().note == 67);
+    CHECK(take.voicesPending());
+    buildVoices(take);
+    CHECK(!take.voicesPending());
+}
+
+TEST(noteTakeRendersTheSameInBlocks)
+{
+    NoteTake take("square");
+    recordTake(take, 48000.0);
+    buildVoices(take);
+
+    std::vector<float> whole(take.frames(), 0.0f), blocks(take.frames(), 0.0f);
+    take.render(0, whole.data(), whole.size(), 1.0f);
+    for (size_t i = 0; i < blocks.size(); i += 256) {
+        take.render(i, blocks.data() + i, std::min<size_t>(256, blocks.size() - i), 1.0f);
+    }
+    CHECK(maxDifference(whole, blocks, 0) == 0.0);
+    CHECK(whole[999] == 0.0f);
+    CHECK(whole[1001] != 0.0f);
+}
+
+TEST(noteTakeSeekKeepsHeldNotes)
+{
+    NoteTake take("sawtooth");
+    recordTake(take, 48000.0);
+    buildVoices(take);
+
+    std::vector<float> whole(take.frames(), 0.0f);
+    take.render(0, whole.data(), whole.size(), 1.0f);
+
+    // Jump into the middle of both held notes, as a loop wrap or Master
+    // Play does; they must sound on at the phase they had reached
+    const size_t seeks[] = { 20000, 3000, 30001, 47999 };
+    for (size_t at : seeks) {
+        std::vector<float> jumped(take.frames(), 0.0f);
+        take.render(0, jumped.data(), 512, 1.0f);
+        take.render(at, jumped.data() + at, jumped.size() - at, 1.0f);
+        CHECK_NEAR(maxDifference(whole, jumped, at), 0.0, 1e-4);
+    }
+}
+
+TEST(noteTakeTempoAndWaveformRerender)
+{
+    NoteTake take("sine");
+    recordTake(take, 48000.0);
+    buildVoices(take);
+    take.setTempo(2.0);
+    CHECK(take.frames() == 24000);
+
+    take.setWaveform("square");
+    CHECK(take.voicesPending());
+    buildVoices(take);
+    std::vector<float> out(take.frames(), 0.0f);
+    take.render(0, out.data(), out.size(), 0.5f);
+    float peak = 0.0f;
+    for (float v : out) peak = std::max(peak, std::fabs(v));
+    CHECK(peak > 0.4f && peak <= 1.1f);
+}
+
+// Enough events for several seek checkpoints, with one note held across
+// all of them and short ones overlapping around it
+TEST(noteTakeSeekFromCheckpointsMatchesPlayback)
+{
+    NoteTake take("sawtooth");
+    take.start(48000.0);
+    take.advance(500);
+    take.record(48, true);
+    for (int i = 0; i < 200; ++i) {
+        take.advance(300);
+        take.record(60 + i % 12, true);
+        take.advance(200);
+        if (i > 0) take.record(60 + (i - 1) % 12, false);
+    }
+    take.advance(1000);
+    take.record(48, false);
+    take.finish(48000.0);
+    CHECK(take.getEvents().size() > 256);
+    buildVoices(take);
+
+    std::vector<float> whole(take.frames(), 0.0f);
+    take.render(0, whole.data(), whole.size(), 1.0f);
+    const size_t seeks[] = { 70000, 600, 33333, 99000, 20000 };
+    for (size_t at : seeks) {
+        std::vector<float> jumped(take.frames(), 0.0f);
+        take.render(at, jumped.data() + at, jumped.size() - at, 1.0f);
+        CHECK_NEAR(maxDifference(whole, jumped, at), 0.0, 1e-4);
+    }
+}
@@ -0,0 +1,63 @@
+#include "Check.h"
+#include "Oscillator.h"
+#include "Voice.h"
+
+// An A4 oscillator playing `waveform`
+static Oscillator makeOscillator(const std::string& waveform)
+{
+    Oscillator osc(kVoiceTableSize, 48000.0);
+    osc.setWaveform(waveform);
+    osc.setNote(69);
+    return osc;
+}
+
+TEST(oscillatorCrossfadesWaveformAtEqualPhase)
+{
+    Oscillator sine = makeOscillator("sine");
+    Oscillator square = makeOscillator("square");
+    Oscillator osc = makeOscillator("sine");
+    for (int i = 0; i < 1000; ++i) {
+        sine.getWaveformValue();
+        square.getWaveformValue();
+        osc.getWaveformValue();
+    }
+
+    // 10 ms at 48 kHz: a linear blend from the old table to the new one
+    osc.setWaveform("square", true);
+    const int fade = 480;
+    for (int i = 0; i < fade; ++i) {
+        double from = sine.getWaveformValue();
+        double to = square.getWaveformValue();
+        double t = static_cast<double>(fade - i) / fade;
+        CHECK_NEAR(osc.getWaveformValue(), to * (1.0 - t) + from * t, 1e-12);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(osc.getWaveformValue() == square.getWaveformValue());
+    }
+}
+
+TEST(oscillatorCopyKeepsItsFade)
+{
+    Oscillator osc = makeOscillator("sawtooth");
+    osc.getWaveformValue();
+    osc.setWaveform("triangle", true);
+    for (int i = 0; i < 100; ++i) osc.getWaveformValue();
+
+    // A copy (as voice pools make) fades on from its own tables
+    Oscillator copy(osc);
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(copy.getWaveformValue() == osc.getWaveformValue());
+    }
+}
+
+TEST(oscillatorSwitchesAtOnceWithoutCrossfade)
+{
+    Oscillator square = makeOscillator("square");
+    Oscillator osc = makeOscillator("sine");
+    square.getWaveformValue();
+    osc.getWaveformValue();
+    osc.setWaveform("square");
+    for (int i = 0; i < 100; ++i) {
+        CHECK(osc.getWaveformValue() == square.getWaveformValue());
+    }
+}
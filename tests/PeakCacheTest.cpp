@@ -0,0 +1,104 @@
+#include "Check.h"
+#include "PeakCache.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Raw min, max and RMS of samples [from, to)
+static PeakCache::Peak rawPeak(const std::vector<float>& samples, size_t from, size_t to)
+{
+    PeakCache::Peak p;
+    p.min = p.max = samples[from];
+    double squares = 0.0;
+    for (size_t i = from; i < to; ++i) {
+        p.min = std::min(p.min, samples[i]);
+        p.max = std::max(p.max, samples[i]);
+        squares += static_cast<double>(samples[i]) * samples[i];
+    }
+    p.rms = static_cast<float>(std::sqrt(squares / (to - from)));
+    return p;
+}
+
+// Noise with a few loud spikes, fed to the cache in uneven pieces
+static std::vector<float> fill(PeakCache& cache, size_t frames)
+{
+    std::mt19937 random(44);
+    std::uniform_real_distribution<float> noise(-0.3f, 0.3f);
+    std::vector<float> samples(frames);
+    for (float& s : samples) s = noise(random);
+    for (size_t i = 12345; i < frames; i += 77777) samples[i] = (i % 2) ? 0.99f : -0.97f;
+
+    std::uniform_int_distribution<size_t> piece(1, 5000);
+    for (size_t pos = 0; pos < frames;) {
+        size_t n = std::min(piece(random), frames - pos);
+        cache.add(samples.data() + pos, n);
+        pos += n;
+    }
+    return samples;
+}
+
+TEST(peakCacheLevelsMatchRawSamples)
+{
+    const size_t frames = 1000000;
+    PeakCache cache(frames);
+    std::vector<float> samples = fill(cache, frames);
+    CHECK(cache.frames() == frames / 64 * 64);
+
+    // Ranges on the entry grid of each level read that level exactly
+    std::mt19937 random(45);
+    for (size_t level = 0; level < PeakCache::kLevels; ++level) {
+        size_t step = PeakCache::levelFrames(level);
+        size_t maxEntries = level + 1 < PeakCache::kLevels ? 7 : 40;
+        std::uniform_int_distribution<size_t> first(0, cache.frames() / step - maxEntries);
+        std::uniform_int_distribution<size_t> count(1, maxEntries);
+        for (int q = 0; q < 300; ++q) {
+            size_t from = first(random) * step;
+            size_t to = from + count(random) * step;
+            PeakCache::Peak cached, raw = rawPeak(samples, from, to);
+            CHECK(cache.range(from, to, cached));
+            CHECK(cached.min == raw.min);
+            CHECK(cached.max == raw.max);
+            CHECK_NEAR(cached.rms, raw.rms, 1e-3);
+        }
+    }
+}
+
+TEST(peakCacheCoversUnalignedRanges)
+{
+    const size_t frames = 300000;
+    PeakCache cache(frames);
+    std::vector<float> samples = fill(cache, frames);
+
+    // An unaligned range reads whole entries around it, so the summary is
+    // at least as wide as the raw range and never wider than its entries
+    std::mt19937 random(46);
+    std::uniform_int_distribution<size_t> position(0, frames - 20000);
+    std::uniform_int_distribution<size_t> span(1, 20000);
+    for (int q = 0; q < 500; ++q) {
+        size_t from = position(random);
+        size_t to = from + span(random);
+        PeakCache::Peak cached;
+        if (!cache.range(from, to, cached)) continue;
+        PeakCache::Peak inner = rawPeak(samples, from, std::min(to, cache.frames()));
+        PeakCache::Peak outer = rawPeak(samples, from / 4096 * 4096,
+                                        std::min(cache.frames(), (to + 4095) / 4096 * 4096));
+        CHECK(cached.min <= inner.min && cached.min >= outer.min);
+        CHECK(cached.max >= inner.max && cached.max <= outer.max);
+    }
+}
+
+TEST(peakCacheClearKeepsWorking)
+{
+    PeakCache cache(200000);
+    fill(cache, 200000);
+    cache.clear();
+    PeakCache::Peak p;
+    CHECK(cache.frames() == 0);
+    CHECK(!cache.range(0, 1000, p));
+
+    std::vector<float> quiet(70000, 0.125f);
+    cache.add(quiet.data(), quiet.size());
+    CHECK(cache.range(0, 65536, p));
+    CHECK(p.min == 0.125f && p.max == 0.125f);
+}
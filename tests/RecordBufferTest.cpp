@@ -0,0 +1,136 @@
+#include "Check.h"
+#include "RecordBuffer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Sample `i` of the test signal; distinct everywhere, so a chunk read from
+// the wrong place shows
+static float testSample(size_t i)
+{
+    return static_cast<float>(i % 100003) / 100003.0f - 0.5f;
+}
+
+// A fresh directory under /tmp for spool files
+static std::string tempDirectory()
+{
+    char name[] = "/tmp/synth-tests-XXXXXX";
+    const char* dir = ::mkdtemp(name);
+    return dir ? dir : "/tmp";
+}
+
+static RecordBuffer::StreamState streamState(bool recording, bool playing, size_t playPosition)
+{
+    RecordBuffer::StreamState state;
+    state.recording = recording;
+    state.playing = playing;
+    state.playPosition = playPosition;
+    state.looping = false;
+    state.loopPosition = 0;
+    return state;
+}
+
+// Resident samples of `take` must be the test signal
+static bool residentSamplesMatch(const RecordBuffer& take)
+{
+    size_t resident = 0;
+    for (size_t i = 0; i < take.size(); i += 97) {
+        float v = take[i];
+        if (v == 0.0f && testSample(i) != 0.0f) continue; // only on disk
+        if (v != testSample(i)) return false;
+        ++resident;
+    }
+    return resident > 0;
+}
+
+// Spool a take of 5.5 chunks while it is recorded, as the disk and
+// allocator threads do, then play it back through the pinned window
+TEST(recordBufferSpoolsAndPlaysFromTheMapping)
+{
+    const double rate = 48000.0;
+    const size_t frames = RecordBuffer::kChunkFrames * 11 / 2;
+    std::string dir = tempDirectory();
+    std::string path = dir + "/take.wav";
+
+    std::shared_ptr<RecordBuffer> take = RecordBuffer::create();
+    RecordBuffer::Evicted evicted;
+    std::vector<float> block(1000);
+    unsigned version = take->spoolPathVersion();
+    for (size_t pos = 0; pos < frames; pos += block.size()) {
+        size_t n = std::min(block.size(), frames - pos);
+        for (size_t i = 0; i < n; ++i) block[i] = testSample(pos + i);
+        take->refill();
+        take->append(block.data(), n);
+        if (take->needsSpool()) take->startSpool(path, rate);
+        take->stream(streamState(true, false, 0), evicted);
+        evicted.release();
+    }
+    take->releaseSpares();
+    CHECK(take->size() == frames);
+    CHECK(take->droppedFrames() == 0);
+    CHECK(take->spoolPath() == path);
+    std::string shownPath;
+    CHECK(take->tryGetSpoolPath(shownPath));
+    CHECK(shownPath == path);
+    CHECK(take->spoolPathVersion() != version);
+    version = take->spoolPathVersion();
+
+    // Finished: everything is written and served from the file, a window
+    // at a time, with the samples that were recorded
+    for (size_t play = 0; play < frames; play += RecordBuffer::kChunkFrames / 2) {
+        take->stream(streamState(false, true, play), evicted);
+        evicted.release();
+        CHECK(take->peaks().frames() == frames / 64 * 64);
+        CHECK(take->peaks().frames() > 0);
+        CHECK(residentSamplesMatch(*take));
+        float played = 0.0f;
+        take->read(play, &played, 1);
+        CHECK(played == testSample(play));
+    }
+
+    // The file on its own holds the take too
+    take->clear();
+    CHECK(take->spoolPath().empty());
+    CHECK(take->spoolPathVersion() != version);
+    RecordBuffer reopened;
+    reopened.openFile(path, rate);
+    CHECK(reopened.size() == frames);
+    for (size_t play = 0; play < frames; play += RecordBuffer::kChunkFrames) {
+        reopened.stream(streamState(false, true, play), evicted);
+        evicted.release();
+        CHECK(residentSamplesMatch(reopened));
+    }
+    reopened.clear();
+    take.reset();
+    RecordBuffer::reclaimRetired();
+    ::unlink(path.c_str());
+    ::rmdir(dir.c_str());
+}
+
+// The chunk table is paged in by refill(); a take that grows past its
+// first page keeps every sample, and one that was never refilled drops
+// what it is given instead of touching a missing page
+TEST(recordBufferPagesInItsChunkTable)
+{
+    const size_t frames = RecordBuffer::kChunkFrames * 66;
+    std::vector<float> block(RecordBuffer::kChunkFrames / 4);
+    RecordBuffer take;
+    for (size_t pos = 0; pos < frames; pos += block.size()) {
+        for (size_t i = 0; i < block.size(); ++i) block[i] = testSample(pos + i);
+        take.refill();
+        take.append(block.data(), block.size());
+    }
+    take.releaseSpares();
+    CHECK(take.size() == frames);
+    CHECK(take.droppedFrames() == 0);
+    CHECK(residentSamplesMatch(take));
+    CHECK(take[frames - 1] == testSample(frames - 1));
+
+    RecordBuffer unprepared;
+    unprepared.append(block.data(), block.size());
+    CHECK(unprepared.size() == 0);
+    CHECK(unprepared.droppedFrames() == block.size());
+}
@@ -0,0 +1,54 @@
+#include "Check.h"
+#include "SmoothedValue.h"
+#include <vector>
+
+TEST(smoothedValueRampsToTargetAndStops)
+{
+    const double rate = 48000.0;
+    SmoothedValue value(0.0f, 0.02f);
+    // 0.02 s per unit at 48 kHz is 960 frames; 128-frame blocks need 8
+    int blocks = 0;
+    float previous = value.end();
+    do {
+        value.advance(1.0f, 128, rate);
+        CHECK(value.start() == previous);
+        CHECK(value.end() >= value.start() && value.end() <= 1.0f);
+        previous = value.end();
+        ++blocks;
+    } while (value.end() != 1.0f && blocks < 100);
+    CHECK(blocks == 8);
+    value.advance(1.0f, 128, rate);
+    CHECK(!value.ramping());
+    CHECK(value.start() == 1.0f && value.end() == 1.0f);
+}
+
+TEST(smoothedValueApplyHitsBlockEndpoints)
+{
+    SmoothedValue value(0.25f, 0.01f);
+    value.advance(-0.5f, 64, 48000.0);
+    CHECK(value.ramping());
+    std::vector<float> ones(64, 1.0f);
+    value.apply(ones.data(), ones.size());
+    // The ramp ends on the block's end value and never passes it
+    CHECK_NEAR(ones.back(), value.end(), 1e-6);
+    CHECK(ones.front() < value.start() && ones.front() > value.end());
+    for (size_t i = 1; i < ones.size(); ++i) {
+        CHECK(ones[i] <= ones[i - 1]);
+    }
+
+    // Held value: a plain multiply
+    SmoothedValue steady(0.5f, 0.01f);
+    steady.advance(0.5f, 64, 48000.0);
+    std::vector<float> twos(64, 2.0f);
+    steady.apply(twos.data(), twos.size());
+    for (float v : twos) CHECK(v == 1.0f);
+}
+
+TEST(smoothedValueJumpsWithinOneStep)
+{
+    SmoothedValue value(0.0f, 0.01f);
+    // A block longer than the whole ramp lands on the target at once
+    value.advance(0.7f, 4800, 48000.0);
+    CHECK(value.end() == 0.7f);
+    CHECK(value.start() == 0.0f);
+}